@@ -0,0 +1,206 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/**
+ * Thread placement and NUMA reporting without libnuma.
+ *
+ * CPU sets are given as lists like "0-7,16-23" or as "node:1", the CPUs of a NUMA node from sysfs.
+ * Threads created by libavcodec inherit the affinity of the thread that calls avcodec_open2, so pinning that
+ * thread around avcodec_open2 places the decoder workers. Memory is placed by the default first-touch policy:
+ * a buffer pool that is allocated and first written by a pinned thread stays on that thread's node,
+ * pageNode() checks where a buffer actually is.
+ * Cross-node traffic is measured with the node-load-misses cache event (loads served by another node)
+ * and the allocation counters of /sys/devices/system/node/node<N>/numastat.
+ */
+
+#define NUMA_SYSFS "/sys/devices/system/node"
+
+static int numaNodeCount()
+{
+    char path[256];
+    int nodes = 0;
+    while (1) {
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%d", nodes);
+        if (access(path, F_OK) != 0)
+            break;
+        nodes += 1;
+    }
+    return nodes > 0 ? nodes : 1;
+}
+
+/* "0-3,8,10-11" or "node:N", returns the number of CPUs in the set or -1 */
+static int parseCpuList(const char* list, cpu_set_t* set)
+{
+    char nodeList[1024];
+
+    CPU_ZERO(set);
+    if (strncmp(list, "node:", 5) == 0) {
+        char path[256];
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%d/cpulist", atoi(list + 5));
+        FILE* file = fopen(path, "r");
+        if (!file)
+            return -1;
+        bool ok = fgets(nodeList, sizeof(nodeList), file) != NULL;
+        fclose(file);
+        if (!ok)
+            return -1;
+        list = nodeList;
+    }
+
+    const char* p = list;
+    while (*p && *p != '\n') {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+            CPU_SET(cpu, set);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(set) > 0 ? CPU_COUNT(set) : -1;
+}
+
+static int pinCurrentThread(const cpu_set_t* set)
+{
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), set) == 0 ? 0 : -1;
+}
+
+/* NUMA node of the CPU the calling thread runs on */
+static int currentNode()
+{
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0)
+        return -1;
+    return (int)node;
+}
+
+/* NUMA node of the page holding p, -1 when unknown (no NUMA support or page not present yet) */
+static int pageNode(const void* p)
+{
+    void* page = (void*)((uintptr_t)p & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1));
+    int status = -1;
+    // move_pages without target nodes only reports where the pages are
+    if (syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0) < 0 || status < 0)
+        return -1;
+    return status;
+}
+
+struct NumaStat
+{
+    long long numaHit;   // allocated on the intended node
+    long long numaMiss;  // wanted another node, got this one
+    long long localNode; // allocated by a thread running on this node
+    long long otherNode; // allocated by a thread running on another node
+};
+
+/* Sums the counters of all nodes */
+static void readNumaStat(NumaStat* stat)
+{
+    char path[256], name[64];
+    long long value;
+
+    memset(stat, 0, sizeof(*stat));
+    for (int node = 0; node < numaNodeCount(); ++node) {
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%d/numastat", node);
+        FILE* file = fopen(path, "r");
+        if (!file)
+            continue;
+        while (fscanf(file, "%63s %lld", name, &value) == 2) {
+            if (strcmp(name, "numa_hit") == 0)
+                stat->numaHit += value;
+            else if (strcmp(name, "numa_miss") == 0)
+                stat->numaMiss += value;
+            else if (strcmp(name, "local_node") == 0)
+                stat->localNode += value;
+            else if (strcmp(name, "other_node") == 0)
+                stat->otherNode += value;
+        }
+        fclose(file);
+    }
+}
+
+/*
+ * Node loads and node load misses (served by a remote node) of this process, including every thread
+ * created after start(). Counts of a thread are only added when it exits, read after joining them.
+ */
+class NodeLoadCounter
+{
+public:
+    NodeLoadCounter() : loadsFd(-1), missesFd(-1) {}
+
+    ~NodeLoadCounter()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        loadsFd = open(PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+        missesFd = open(PERF_COUNT_HW_CACHE_RESULT_MISS);
+        if (loadsFd < 0 || missesFd < 0) {
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    bool available() const
+    {
+        return loadsFd >= 0;
+    }
+
+    void read(long long* loads, long long* misses)
+    {
+        *loads = value(loadsFd);
+        *misses = value(missesFd);
+    }
+
+    void stop()
+    {
+        if (loadsFd >= 0)
+            close(loadsFd);
+        if (missesFd >= 0)
+            close(missesFd);
+        loadsFd = missesFd = -1;
+    }
+
+private:
+    static int open(int result)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    static long long value(int fd)
+    {
+        long long count = 0;
+        if (fd < 0 || ::read(fd, &count, sizeof(count)) != sizeof(count))
+            return -1;
+        return count;
+    }
+
+    int loadsFd;
+    int missesFd;
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+/**
+ * Heap allocation accounting, compiled in with -DALLOC_ACCOUNTING (see the *_alloc.out lines in compile.sh).
+ *
+ * The program interposes the libc allocator (malloc, calloc, realloc, free, posix_memalign, ...),
+ * the public libavutil allocator (av_malloc, av_mallocz, av_calloc, av_realloc, av_free, av_freep)
+ * and the global operator new/delete. The libc counters see every heap allocation of the process,
+ * the libav and C++ counters tell where they came from. Allocations libavutil makes internally
+ * (av_frame_alloc, buffer pools) do not go through the exported symbols, they only show up in the heap numbers.
+ *
+ * The decode loop calls ALLOC_ACCOUNTING_FRAME() once per output frame. After a warmup the counters
+ * are snapshotted, the report gives allocations per frame, live bytes at steady state, their growth
+ * per frame (a least squares fit, so leaks show up as a positive slope) and peak RSS.
+ * ALLOC_ACCOUNTING_REPORT() returns 1 when the steady state heap allocations per frame exceed the
+ * budget given in the ALLOC_BUDGET environment variable, use it as exit code of the benchmark.
+ *
+ *   ALLOC_BUDGET         maximum heap allocations per frame at steady state
+ *   ALLOC_WARMUP_FRAMES  frames excluded from the steady state, default 100
+ *
+ * The symbols are defined here, so include it from a single translation unit per program.
+ */
+
+#ifdef ALLOC_ACCOUNTING
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <malloc.h>
+#include <dlfcn.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <new>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+struct AllocCounters
+{
+    std::atomic<int64_t> heapAllocs;
+    std::atomic<int64_t> heapFrees;
+    std::atomic<int64_t> heapLive;
+    std::atomic<int64_t> heapPeak;
+    std::atomic<int64_t> avAllocs;
+    std::atomic<int64_t> avFrees;
+    std::atomic<int64_t> cxxAllocs;
+    std::atomic<int64_t> cxxFrees;
+};
+
+// zero initialized before any constructor runs, the allocator is used long before main
+static AllocCounters allocCounters;
+
+static inline void allocCountAlloc(void* ptr)
+{
+    if (!ptr)
+        return;
+    int64_t size = malloc_usable_size(ptr);
+    int64_t live = allocCounters.heapLive.fetch_add(size, std::memory_order_relaxed) + size;
+    allocCounters.heapAllocs.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t peak = allocCounters.heapPeak.load(std::memory_order_relaxed);
+    while (live > peak && !allocCounters.heapPeak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        ;
+}
+
+static inline void allocCountFree(void* ptr)
+{
+    if (!ptr)
+        return;
+    allocCounters.heapLive.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    allocCounters.heapFrees.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* libc */
+
+extern "C" void* malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    allocCountAlloc(ptr);
+    return ptr;
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    void* ptr = __libc_calloc(count, size);
+    allocCountAlloc(ptr);
+    return ptr;
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    // a realloc is a free of the old block and an allocation of the new one
+    if (ptr && size == 0) {
+        allocCountFree(ptr);
+        return __libc_realloc(ptr, size);
+    }
+    size_t oldSize = ptr ? malloc_usable_size(ptr) : 0;
+    void* newPtr = __libc_realloc(ptr, size);
+    if (newPtr) {
+        if (ptr) {
+            allocCounters.heapLive.fetch_sub(oldSize, std::memory_order_relaxed);
+            allocCounters.heapFrees.fetch_add(1, std::memory_order_relaxed);
+        }
+        allocCountAlloc(newPtr);
+    }
+    return newPtr;
+}
+
+extern "C" void free(void* ptr)
+{
+    allocCountFree(ptr);
+    __libc_free(ptr);
+}
+
+extern "C" int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    allocCountAlloc(ptr);
+    *memptr = ptr;
+    return 0;
+}
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+    void* ptr = __libc_memalign(alignment, size);
+    allocCountAlloc(ptr);
+    return ptr;
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/* libavutil, forwarded to the real functions */
+
+#define ALLOC_REAL(name) \
+    static decltype(&name) real = NULL; \
+    if (!real) \
+        real = (decltype(&name))dlsym(RTLD_NEXT, #name)
+
+extern "C" void* av_malloc(size_t size)
+{
+    ALLOC_REAL(av_malloc);
+    allocCounters.avAllocs.fetch_add(1, std::memory_order_relaxed);
+    return real(size);
+}
+
+extern "C" void* av_mallocz(size_t size)
+{
+    ALLOC_REAL(av_mallocz);
+    allocCounters.avAllocs.fetch_add(1, std::memory_order_relaxed);
+    return real(size);
+}
+
+extern "C" void* av_calloc(size_t count, size_t size)
+{
+    ALLOC_REAL(av_calloc);
+    allocCounters.avAllocs.fetch_add(1, std::memory_order_relaxed);
+    return real(count, size);
+}
+
+extern "C" void* av_realloc(void* ptr, size_t size)
+{
+    ALLOC_REAL(av_realloc);
+    allocCounters.avAllocs.fetch_add(1, std::memory_order_relaxed);
+    return real(ptr, size);
+}
+
+extern "C" void av_free(void* ptr)
+{
+    ALLOC_REAL(av_free);
+    if (ptr)
+        allocCounters.avFrees.fetch_add(1, std::memory_order_relaxed);
+    real(ptr);
+}
+
+extern "C" void av_freep(void* arg)
+{
+    ALLOC_REAL(av_freep);
+    if (*(void**)arg)
+        allocCounters.avFrees.fetch_add(1, std::memory_order_relaxed);
+    real(arg);
+}
+
+/* C++ */
+
+void* operator new(size_t size)
+{
+    allocCounters.cxxAllocs.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr)
+        allocCounters.cxxFrees.fetch_add(1, std::memory_order_relaxed);
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+/* Per frame bookkeeping, only called from the decoding thread */
+
+struct AllocSnapshot
+{
+    int64_t heapAllocs, heapFrees, avAllocs, cxxAllocs;
+};
+
+static int64_t allocFrames = 0;
+static int64_t allocWarmupFrames = -1;
+static int64_t allocSteadyStart = 0;
+static AllocSnapshot allocSteadySnapshot;
+static double allocSumX, allocSumY, allocSumXX, allocSumXY;
+
+static AllocSnapshot allocSnapshot()
+{
+    AllocSnapshot s = {
+        allocCounters.heapAllocs.load(std::memory_order_relaxed),
+        allocCounters.heapFrees.load(std::memory_order_relaxed),
+        allocCounters.avAllocs.load(std::memory_order_relaxed),
+        allocCounters.cxxAllocs.load(std::memory_order_relaxed),
+    };
+    return s;
+}
+
+static int64_t allocNowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void allocAccountingFrame()
+{
+    if (allocWarmupFrames < 0) {
+        const char* warmup = getenv("ALLOC_WARMUP_FRAMES");
+        allocWarmupFrames = warmup ? atoll(warmup) : 100;
+    }
+
+    allocFrames += 1;
+    if (allocFrames == allocWarmupFrames + 1) {
+        allocSteadySnapshot = allocSnapshot();
+        allocSteadyStart = allocNowUs();
+    }
+    if (allocFrames > allocWarmupFrames) {
+        // live bytes in MB against the frame number, the slope is the leak rate
+        double x = allocFrames - allocWarmupFrames;
+        double y = allocCounters.heapLive.load(std::memory_order_relaxed) / (1024.0 * 1024.0);
+        allocSumX += x;
+        allocSumY += y;
+        allocSumXX += x * x;
+        allocSumXY += x * y;
+    }
+}
+
+static int allocAccountingReport()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    AllocSnapshot end = allocSnapshot();
+    int64_t steadyFrames = allocFrames - allocWarmupFrames;
+
+    fprintf(stdout, "Allocation accounting, %lld frames, %lld warmup\n", (long long)allocFrames,
+            (long long)allocWarmupFrames);
+    fprintf(stdout, "Peak RSS %.1f MB, peak live heap %.1f MB, live heap at exit %.1f MB\n", usage.ru_maxrss / 1024.0,
+            allocCounters.heapPeak.load() / (1024.0 * 1024.0), allocCounters.heapLive.load() / (1024.0 * 1024.0));
+    fprintf(stdout, "Total: %lld heap allocations, %lld frees, %lld av_malloc family calls, %lld operator new\n",
+            (long long)end.heapAllocs, (long long)end.heapFrees, (long long)end.avAllocs, (long long)end.cxxAllocs);
+
+    if (steadyFrames < 2) {
+        fprintf(stdout, "Not enough frames after the warmup for a steady state\n");
+        return 0;
+    }
+
+    double n = steadyFrames;
+    double heapPerFrame = (end.heapAllocs - allocSteadySnapshot.heapAllocs) / n;
+    double freesPerFrame = (end.heapFrees - allocSteadySnapshot.heapFrees) / n;
+    double avPerFrame = (end.avAllocs - allocSteadySnapshot.avAllocs) / n;
+    double cxxPerFrame = (end.cxxAllocs - allocSteadySnapshot.cxxAllocs) / n;
+    double slope = (n * allocSumXY - allocSumX * allocSumY) / (n * allocSumXX - allocSumX * allocSumX);
+    double seconds = (allocNowUs() - allocSteadyStart) / 1000000.0;
+
+    fprintf(stdout, "Steady state per frame: %.2f heap allocations, %.2f frees, %.2f av_malloc family, %.2f operator new\n",
+            heapPerFrame, freesPerFrame, avPerFrame, cxxPerFrame);
+    fprintf(stdout, "Steady state live heap %.1f MB, growth %.1f KB/frame, %.1f KB/s\n", allocSumY / n,
+            slope * 1024.0, seconds > 0 ? slope * 1024.0 * n / seconds : 0.0);
+
+    const char* budget = getenv("ALLOC_BUDGET");
+    if (budget && heapPerFrame > atof(budget)) {
+        fprintf(stdout, "FAIL: %.2f heap allocations per frame, budget %s\n", heapPerFrame, budget);
+        return 1;
+    }
+    return 0;
+}
+
+#define ALLOC_ACCOUNTING_FRAME() allocAccountingFrame()
+#define ALLOC_ACCOUNTING_REPORT() allocAccountingReport()
+
+#else
+
+#define ALLOC_ACCOUNTING_FRAME() do { } while (0)
+#define ALLOC_ACCOUNTING_REPORT() 0
+
+#endif
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Runs the allocation accounting builds on one input, fails when a sample goes over the
+# steady state heap allocations per frame budget.
+# Usage: ./allocbench.sh <input file> [device] [budget]
+
+INPUT=${1:?Usage: $0 <input file> [device] [budget]}
+DEVICE=${2:-/dev/dri/renderD128}
+export ALLOC_BUDGET=${3:-${ALLOC_BUDGET:-50}}
+
+status=0
+
+run() {
+    echo "== $*"
+    "$@" > /tmp/allocbench.log 2>&1
+    result=$?
+    grep -E "^(Allocation|Peak|Total|Steady|FAIL|Not enough)" /tmp/allocbench.log
+    if [ $result -ne 0 ]; then
+        echo "FAILED (exit $result)"
+        status=1
+    fi
+}
+
+run ./swdecode_alloc.out "$INPUT"
+run ./hwdecode_alloc.out "$INPUT" "$DEVICE"
+run ./hwdecode_without_filter_alloc.out "$INPUT" "$DEVICE"
+
+exit $status
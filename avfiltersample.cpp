@@ -126,8 +126,8 @@ int main(int argc, char **argv)
 {
     int ret;
     AVPacket packet;
-    AVFrame *filt_frame;
-    AVFrame *frame;
+    AVFrame *filt_frame = NULL;
+    AVFrame *frame = NULL;
     int got_frame;
 
     if (argc != 2) {
@@ -166,14 +166,16 @@ int main(int argc, char **argv)
                 while (1) {
                     filt_frame = av_frame_alloc();
                     ret = av_buffersink_get_frame(buffersink_ctx, filt_frame);
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                        av_frame_free(&filt_frame);
                         break;
+                    }
                     if (ret < 0)
                         goto end;
                     if (imageNumber % 10 == 0) {
                         display_frame(filt_frame, buffersink_ctx->inputs[0]->time_base);
-                        av_frame_free(&filt_frame);
                     }
+                    av_frame_free(&filt_frame);
                     imageNumber += 1;
                 }
             }
@@ -0,0 +1,71 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+/**
+ * Bounded queue used to hand owned pointers (frames, packets) from one thread to another.
+ * push() takes ownership of the item and blocks while the queue is full, pop() returns NULL
+ * once the queue was closed and drained. Items still queued, or pushed after close(), are
+ * released with Free (av_frame_free, av_packet_free).
+ */
+template <typename T, void (*Free)(T**)>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    ~BoundedQueue()
+    {
+        for (T* item : items) {
+            Free(&item);
+        }
+    }
+
+    void push(T* item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return items.size() < capacity || closed; });
+        if (closed) {
+            Free(&item);
+            return;
+        }
+        items.push_back(item);
+        notEmpty.notify_one();
+    }
+
+    T* pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return NULL;
+        }
+        T* item = items.front();
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+    std::deque<T*> items;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};
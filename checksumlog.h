@@ -0,0 +1,192 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "xxhash.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+/**
+ * Per frame checksum log, to verify a fast path against the reference path without writing images.
+ *
+ * Every converted output frame is hashed with XXH64 (the visible bytes of each row, chained through
+ * the seed, so padding never matters), optionally also the planes of the decoded frame. Records are
+ * keyed by pts, framecompare matches two logs and reports the first divergent frame.
+ * For the pixel error of divergent frames the output frames can additionally be dumped raw,
+ * starting at a pts, e.g. just around the first divergence found by a previous run.
+ *
+ * Log: ChecksumLogHeader, then one ChecksumRecord per frame, followed by ChecksumPlanes if hasPlanes.
+ * Dump: ChecksumLogHeader, then per frame the int64 pts and width * height * bytesPerPixel bytes.
+ */
+
+#define CHECKSUM_LOG_MAGIC "FRMSUMS1"
+#define CHECKSUM_DUMP_MAGIC "FRMDUMP1"
+#define CHECKSUM_DUMP_FRAMES 250
+
+struct ChecksumLogHeader
+{
+    char magic[8];
+    int32_t width;
+    int32_t height;
+    int32_t format; // of the output frames
+    int32_t hasPlanes;
+};
+
+struct ChecksumRecord
+{
+    int64_t pts;
+    int64_t frameNumber;
+    uint64_t outputHash;
+};
+
+struct ChecksumPlanes
+{
+    int32_t format; // of the decoded frame, hashes are only comparable for the same format
+    int32_t planeCount;
+    uint64_t planeHash[4];
+};
+
+static uint64_t checksumPlane(const uint8_t* data, int linesize, int rowBytes, int rows)
+{
+    uint64_t hash = 0;
+    for (int y = 0; y < rows; ++y)
+        hash = xxh64(data + (size_t)y * linesize, rowBytes, hash);
+    return hash;
+}
+
+/* Hashes all planes of a software frame, returns the number of planes */
+static int checksumFrame(const AVFrame* frame, uint64_t* planeHash)
+{
+    AVPixelFormat format = (AVPixelFormat)frame->format;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+    if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+        return 0;
+
+    int planes = av_pix_fmt_count_planes(format);
+    for (int i = 0; i < planes && i < 4; ++i) {
+        int rows = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        planeHash[i] = checksumPlane(frame->data[i], frame->linesize[i],
+                                     av_image_get_linesize(format, frame->width, i), rows);
+    }
+    return planes;
+}
+
+class ChecksumLog
+{
+public:
+    ChecksumLog() : log(NULL), dump(NULL), dumpFromPts(0), dumped(0), frameNumber(0), hashPlanes(false) {}
+
+    ~ChecksumLog()
+    {
+        close();
+    }
+
+    int open(const char* filename, bool hashDecodedPlanes, int width, int height, AVPixelFormat format)
+    {
+        if (!(log = fopen(filename, "wb"))) {
+            fprintf(stderr, "Cannot open checksum log '%s'\n", filename);
+            return -1;
+        }
+        hashPlanes = hashDecodedPlanes;
+        fillHeader(CHECKSUM_LOG_MAGIC, width, height, format);
+        fwrite(&header, sizeof(header), 1, log);
+        return 0;
+    }
+
+    /* Also writes the raw output frames from pts fromPts on, at most CHECKSUM_DUMP_FRAMES of them */
+    int openDump(const char* filename, int64_t fromPts)
+    {
+        if (!(dump = fopen(filename, "wb"))) {
+            fprintf(stderr, "Cannot open frame dump '%s'\n", filename);
+            return -1;
+        }
+        dumpFromPts = fromPts;
+        ChecksumLogHeader dumpHeader = header;
+        memcpy(dumpHeader.magic, CHECKSUM_DUMP_MAGIC, sizeof(dumpHeader.magic));
+        fwrite(&dumpHeader, sizeof(dumpHeader), 1, dump);
+        return 0;
+    }
+
+    /* decoded may be NULL, output points to the converted frame in the format given to open() */
+    void add(int64_t pts, const AVFrame* decoded, uint8_t* const* outputData, const int* outputLinesize)
+    {
+        if (!log)
+            return;
+
+        ChecksumRecord record;
+        record.pts = pts;
+        record.frameNumber = frameNumber++;
+        record.outputHash = 0;
+
+        int planes = av_pix_fmt_count_planes((AVPixelFormat)header.format);
+        for (int i = 0; i < planes; ++i) {
+            int rows = outputRows(i);
+            record.outputHash = xxh64(&record.outputHash, sizeof(record.outputHash),
+                                      checksumPlane(outputData[i], outputLinesize[i], outputRowBytes(i), rows));
+        }
+        fwrite(&record, sizeof(record), 1, log);
+
+        if (hashPlanes) {
+            ChecksumPlanes decodedPlanes;
+            memset(&decodedPlanes, 0, sizeof(decodedPlanes));
+            if (decoded) {
+                decodedPlanes.format = decoded->format;
+                decodedPlanes.planeCount = checksumFrame(decoded, decodedPlanes.planeHash);
+            }
+            fwrite(&decodedPlanes, sizeof(decodedPlanes), 1, log);
+        }
+
+        if (dump && pts >= dumpFromPts && dumped < CHECKSUM_DUMP_FRAMES) {
+            fwrite(&pts, sizeof(pts), 1, dump);
+            for (int i = 0; i < planes; ++i) {
+                for (int y = 0; y < outputRows(i); ++y)
+                    fwrite(outputData[i] + (size_t)y * outputLinesize[i], 1, outputRowBytes(i), dump);
+            }
+            dumped += 1;
+        }
+    }
+
+    void close()
+    {
+        if (log)
+            fclose(log);
+        if (dump)
+            fclose(dump);
+        log = NULL;
+        dump = NULL;
+    }
+
+private:
+    void fillHeader(const char* magic, int width, int height, AVPixelFormat format)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, magic, sizeof(header.magic));
+        header.width = width;
+        header.height = height;
+        header.format = format;
+        header.hasPlanes = hashPlanes;
+    }
+
+    int outputRowBytes(int plane) const
+    {
+        return av_image_get_linesize((AVPixelFormat)header.format, header.width, plane);
+    }
+
+    int outputRows(int plane) const
+    {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)header.format);
+        return (plane == 1 || plane == 2) ? AV_CEIL_RSHIFT(header.height, desc->log2_chroma_h) : header.height;
+    }
+
+    FILE* log;
+    FILE* dump;
+    int64_t dumpFromPts;
+    int dumped;
+    int64_t frameNumber;
+    bool hashPlanes;
+    ChecksumLogHeader header;
+};
@@ -1,4 +1,26 @@
-g++ -O0 -g -w  hwdecode.cpp -fpermissive -o hwdecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale  libavfilter`
-g++ -O0 -g -w  hwdecode_without_filter.cpp -fpermissive -o hwdecode_without_filter.out `pkg-config --libs libavcodec libavformat libavutil libswscale  libavfilter`
-g++ -O0 -g -w  swdecode.cpp -fpermissive -o swdecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O0 -g -w  hwdecode.cpp -fpermissive -pthread -o hwdecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale libswresample  libavfilter`
+g++ -O0 -g -w  hwdecode_without_filter.cpp -fpermissive -pthread -o hwdecode_without_filter.out `pkg-config --libs libavcodec libavformat libavutil libswscale libswresample  libavfilter`
+g++ -O0 -g -w  swdecode.cpp -fpermissive -pthread -o swdecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale libswresample`
 #g++ -O0 -g -w avfiltersample.cpp -fpermissive -o avfilter.out `pkg-config --libs libavcodec libavformat libavutil libswscale libavfilter`
+g++ -O0 -g -w  proxytranscode.cpp -fpermissive -pthread -o proxytranscode.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O0 -g -w  seekbench.cpp -fpermissive -o seekbench.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O0 -g -w  thumbnail.cpp -fpermissive -o thumbnail.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O0 -g -w  pipeingest.cpp -fpermissive -pthread -o pipeingest.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O0 -g -w  realtimepreview.cpp -fpermissive -pthread -o realtimepreview.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O0 -g -w  shmdecode.cpp -fpermissive -o shmdecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale` -lrt
+g++ -O2 -g -w  shmreader.cpp -o shmreader.out -lrt
+g++ -O0 -g -w  y4moutput.cpp -fpermissive -o y4moutput.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  templatedecode.cpp -fpermissive -o templatedecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale libavfilter`
+g++ -O0 -g -w  -DALLOC_ACCOUNTING swdecode.cpp -fpermissive -pthread -o swdecode_alloc.out `pkg-config --libs libavcodec libavformat libavutil libswscale libswresample` -ldl
+g++ -O0 -g -w  -DALLOC_ACCOUNTING hwdecode.cpp -fpermissive -pthread -o hwdecode_alloc.out `pkg-config --libs libavcodec libavformat libavutil libswscale libswresample  libavfilter` -ldl
+g++ -O0 -g -w  -DALLOC_ACCOUNTING hwdecode_without_filter.cpp -fpermissive -pthread -o hwdecode_without_filter_alloc.out `pkg-config --libs libavcodec libavformat libavutil libswscale libswresample  libavfilter` -ldl
+g++ -O0 -g -w  governordecode.cpp -fpermissive -o governordecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  scalerreport.cpp -fpermissive -o scalerreport.out `pkg-config --libs libavcodec libavformat libavutil libswscale libavfilter`
+g++ -O2 -g -w  framecompare.cpp -fpermissive -o framecompare.out `pkg-config --libs libavutil`
+g++ -O2 -g -w  thumbselect.cpp -fpermissive -o thumbselect.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  roiscale.cpp -fpermissive -o roiscale.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  decodedaemon.cpp -fpermissive -pthread -o decodedaemon.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  loadgen.cpp -fpermissive -pthread -o loadgen.out `pkg-config --libs libavformat libavutil`
+g++ -O2 -g -w  numadecode.cpp -fpermissive -pthread -o numadecode.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  scopes.cpp -fpermissive -o scopes.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
+g++ -O2 -g -w  scrubbench.cpp -fpermissive -o scrubbench.out `pkg-config --libs libavcodec libavformat libavutil libswscale`
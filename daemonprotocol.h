@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <vector>
+
+/**
+ * Protocol between the decode daemon and its clients over a local Unix stream socket.
+ *
+ * Every message is a DaemonMessageHeader (body length and type, host byte order) followed by the body.
+ * A client submits jobs with DAEMON_SUBMIT and may cancel them with DAEMON_CANCEL, the daemon answers every
+ * submitted job with exactly one DAEMON_RESULT (done, failed or cancelled). Job ids are chosen by the client
+ * and only need to be unique per connection, several jobs may be in flight on one connection.
+ */
+
+#define DAEMON_SOCKET "/tmp/decodedaemon.sock"
+#define DAEMON_MAX_MESSAGE 65536
+#define DAEMON_MAX_PATH 1024
+
+enum DaemonMessageType
+{
+    DAEMON_SUBMIT = 1, // DaemonSubmit
+    DAEMON_CANCEL = 2, // DaemonCancel
+    DAEMON_RESULT = 3, // DaemonResult
+};
+
+enum DaemonJobType
+{
+    JOB_THUMBNAIL = 0, // one frame at timestampMs, width x height rgb24 ppm
+    JOB_STRIP = 1,     // count frames spread over the clip side by side, each width x height, one ppm
+    JOB_PROXY = 2,     // whole clip to an all-intra mjpeg proxy of width x height
+};
+
+enum DaemonJobStatus
+{
+    STATUS_DONE = 0,
+    STATUS_FAILED = -1,
+    STATUS_CANCELLED = -2,
+};
+
+struct DaemonMessageHeader
+{
+    uint32_t length; // of the body
+    uint32_t type;
+};
+
+struct DaemonSubmit
+{
+    uint64_t jobId;
+    int32_t jobType;
+    int32_t priority; // higher runs first, same priority in submission order
+    int64_t timestampMs;
+    int32_t count;
+    int32_t width;
+    int32_t height;
+    int32_t reserved;
+    char input[DAEMON_MAX_PATH];
+    char output[DAEMON_MAX_PATH];
+};
+
+struct DaemonCancel
+{
+    uint64_t jobId;
+};
+
+struct DaemonResult
+{
+    uint64_t jobId;
+    int32_t status;
+    int32_t frames;     // decoded frames used for the output
+    int32_t warmInput;  // the input was still open from an earlier job
+    int32_t reserved;
+    int64_t queueUs;    // waiting for a worker
+    int64_t runUs;
+};
+
+static int daemonWriteAll(int fd, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t written = send(fd, p, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return -1;
+        p += written;
+        size -= written;
+    }
+    return 0;
+}
+
+static int daemonReadAll(int fd, void* data, size_t size)
+{
+    uint8_t* p = (uint8_t*)data;
+    while (size > 0) {
+        ssize_t got = read(fd, p, size);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return -1;
+        p += got;
+        size -= got;
+    }
+    return 0;
+}
+
+/* Not thread safe, the caller serializes writers of one socket */
+static int daemonSend(int fd, uint32_t type, const void* body, uint32_t length)
+{
+    DaemonMessageHeader header = { length, type };
+    if (daemonWriteAll(fd, &header, sizeof(header)) < 0)
+        return -1;
+    return daemonWriteAll(fd, body, length);
+}
+
+/* Returns the message type, -1 on a closed socket or an invalid message */
+static int daemonReceive(int fd, std::vector<uint8_t>* body)
+{
+    DaemonMessageHeader header;
+    if (daemonReadAll(fd, &header, sizeof(header)) < 0 || header.length > DAEMON_MAX_MESSAGE)
+        return -1;
+    body->resize(header.length);
+    if (header.length > 0 && daemonReadAll(fd, body->data(), header.length) < 0)
+        return -1;
+    return (int)header.type;
+}
@@ -1,6 +1,7 @@
+#pragma once
 #include <stdio.h>
 
-static void ppm_save(unsigned char* buf, int wrap, int xsize, int ysize, char* filename)
+static void ppm_save(unsigned char* buf, int wrap, int xsize, int ysize, const char* filename)
 {
     FILE* f;
     int i;
@@ -0,0 +1,744 @@
+/**
+ * @file
+ * Long running decode daemon.
+ *
+ * Takes thumbnail, strip and proxy jobs over a Unix socket (daemonprotocol.h) and runs them on one
+ * worker pool, highest priority first. Queued jobs are cancelled immediately, running ones stop at the
+ * next packet or frame. What a sample binary pays again for every request stays warm between jobs:
+ * recently opened inputs (format context with its probed streams and an open decoder) are pooled and
+ * only seeked and flushed for the next job, every worker keeps its SwsContexts (RoiScaler) and its
+ * output buffers (AVBufferPool per size). Use loadgen to measure it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <string>
+#include <list>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "daemonprotocol.h"
+#include "roiscaler.h"
+
+extern "C" {
+#include "debugimage.h"
+#include "proxyencoder.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+#define MAX_OUTPUT_SIZE 8192
+#define MAX_STRIP_FRAMES 64
+#define MAX_OUTPUT_POOLS 8 // per worker, clients pick the output sizes
+
+struct Connection
+{
+    explicit Connection(int fd) : fd(fd) {}
+
+    ~Connection()
+    {
+        close(fd);
+    }
+
+    void sendResult(const DaemonResult& result)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        daemonSend(fd, DAEMON_RESULT, &result, sizeof(result));
+    }
+
+    int fd;
+    std::mutex writeMutex;
+};
+
+struct Job
+{
+    DaemonSubmit request;
+    std::shared_ptr<Connection> connection; // keeps the socket open until the job is answered
+    std::atomic<bool> cancelled;
+    uint64_t sequence;
+    int64_t submitted;
+    int64_t started;
+};
+
+typedef std::pair<Connection*, uint64_t> JobKey;
+
+/* Priority queue of the submitted jobs, also tracks the running ones for cancellation */
+class JobQueue
+{
+public:
+    JobQueue() : sequence(0), closed(false) {}
+
+    /* Fails for a job id already in use on the connection */
+    bool push(const std::shared_ptr<Job>& job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        JobKey key(job->connection.get(), job->request.jobId);
+        if (closed || active.count(key))
+            return false;
+        job->sequence = sequence++;
+        active[key] = job;
+        queued.push_back(job);
+        std::push_heap(queued.begin(), queued.end(), runsLater);
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /* Highest priority first, NULL once the queue was closed */
+    std::shared_ptr<Job> pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return !queued.empty() || closed; });
+        if (closed)
+            return NULL;
+        std::pop_heap(queued.begin(), queued.end(), runsLater);
+        std::shared_ptr<Job> job = queued.back();
+        queued.pop_back();
+        return job;
+    }
+
+    /* A queued job is removed and returned for the caller to answer, a running one is only flagged */
+    std::shared_ptr<Job> cancel(Connection* connection, uint64_t jobId)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = active.find(JobKey(connection, jobId));
+        if (found == active.end())
+            return NULL;
+        std::shared_ptr<Job> job = found->second;
+        job->cancelled = true;
+        if (!removeQueued(job))
+            return NULL;
+        active.erase(found);
+        return job;
+    }
+
+    /* The client went away, nobody is waiting for its results */
+    void cancelAll(Connection* connection)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = active.begin(); it != active.end();) {
+            if (it->first.first != connection) {
+                ++it;
+                continue;
+            }
+            it->second->cancelled = true;
+            if (removeQueued(it->second))
+                it = active.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    void finished(const std::shared_ptr<Job>& job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active.erase(JobKey(job->connection.get(), job->request.jobId));
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    /* Heap order: lower priority, then later submission runs later */
+    static bool runsLater(const std::shared_ptr<Job>& a, const std::shared_ptr<Job>& b)
+    {
+        if (a->request.priority != b->request.priority)
+            return a->request.priority < b->request.priority;
+        return a->sequence > b->sequence;
+    }
+
+    bool removeQueued(const std::shared_ptr<Job>& job)
+    {
+        auto it = std::find(queued.begin(), queued.end(), job);
+        if (it == queued.end())
+            return false;
+        queued.erase(it);
+        std::make_heap(queued.begin(), queued.end(), runsLater);
+        return true;
+    }
+
+    uint64_t sequence;
+    bool closed;
+    std::vector<std::shared_ptr<Job> > queued;
+    std::map<JobKey, std::shared_ptr<Job> > active;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+};
+
+struct OpenInput
+{
+    std::string path;
+    time_t mtime;
+    off_t size;
+    AVFormatContext* input_ctx;
+    AVCodecContext* decoder_ctx;
+    AVStream* video;
+    int video_stream;
+};
+
+static void close_input(OpenInput* input)
+{
+    avcodec_free_context(&input->decoder_ctx);
+    avformat_close_input(&input->input_ctx);
+    delete input;
+}
+
+static OpenInput* open_input(const char* path, const struct stat& st, int decoderThreads)
+{
+    const AVCodec* decoder = NULL;
+    OpenInput* input = new OpenInput();
+    input->path = path;
+    input->mtime = st.st_mtime;
+    input->size = st.st_size;
+    input->input_ctx = NULL;
+    input->decoder_ctx = NULL;
+
+    if (avformat_open_input(&input->input_ctx, path, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", path);
+        delete input;
+        return NULL;
+    }
+
+    if (avformat_find_stream_info(input->input_ctx, NULL) < 0 ||
+        (input->video_stream = av_find_best_stream(input->input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0)) < 0) {
+        fprintf(stderr, "Cannot find a video stream in '%s'\n", path);
+        close_input(input);
+        return NULL;
+    }
+    input->video = input->input_ctx->streams[input->video_stream];
+
+    if (!(input->decoder_ctx = avcodec_alloc_context3(decoder)) ||
+        avcodec_parameters_to_context(input->decoder_ctx, input->video->codecpar) < 0) {
+        close_input(input);
+        return NULL;
+    }
+
+    // several decoders run at the same time, each gets its share of the cores
+    input->decoder_ctx->thread_count = decoderThreads;
+    input->decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if (avcodec_open2(input->decoder_ctx, decoder, NULL) < 0) {
+        fprintf(stderr, "Failed to open codec for '%s'\n", path);
+        close_input(input);
+        return NULL;
+    }
+    return input;
+}
+
+/* Recently opened inputs, each one is used by one job at a time */
+class InputPool
+{
+public:
+    InputPool(size_t maxIdle, int decoderThreads)
+        : maxIdle(maxIdle), decoderThreads(decoderThreads), hits(0), misses(0)
+    {
+    }
+
+    ~InputPool()
+    {
+        for (OpenInput* input : idle)
+            close_input(input);
+    }
+
+    /* warm is set when the input was still open, a file changed since is opened again */
+    OpenInput* acquire(const char* path, bool* warm)
+    {
+        struct stat st;
+        OpenInput* stale = NULL;
+        OpenInput* found = NULL;
+
+        *warm = false;
+        if (stat(path, &st) < 0) {
+            fprintf(stderr, "Cannot open input file '%s'\n", path);
+            return NULL;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto it = idle.begin(); it != idle.end(); ++it) {
+                if ((*it)->path != path)
+                    continue;
+                if ((*it)->mtime == st.st_mtime && (*it)->size == st.st_size)
+                    found = *it;
+                else
+                    stale = *it;
+                idle.erase(it);
+                break;
+            }
+            if (found)
+                hits += 1;
+            else
+                misses += 1;
+        }
+
+        if (stale)
+            close_input(stale);
+        if (found) {
+            *warm = true;
+            return found;
+        }
+        return open_input(path, st, decoderThreads);
+    }
+
+    void release(OpenInput* input)
+    {
+        std::vector<OpenInput*> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_front(input);
+            while (idle.size() > maxIdle) {
+                evicted.push_back(idle.back());
+                idle.pop_back();
+            }
+        }
+        for (OpenInput* old : evicted)
+            close_input(old);
+    }
+
+    long getHits() const
+    {
+        return hits;
+    }
+
+    long getMisses() const
+    {
+        return misses;
+    }
+
+private:
+    size_t maxIdle;
+    int decoderThreads;
+    std::atomic<long> hits;
+    std::atomic<long> misses;
+    std::list<OpenInput*> idle; // most recently used first
+    std::mutex mutex;
+};
+
+/* Refcounted output frames from one AVBufferPool per buffer size */
+class OutputFramePool
+{
+public:
+    ~OutputFramePool()
+    {
+        for (auto& entry : pools)
+            av_buffer_pool_uninit(&entry.second.pool);
+    }
+
+    AVFrame* get(int width, int height, AVPixelFormat format)
+    {
+        int size = av_image_get_buffer_size(format, width, height, 32);
+        if (size < 0)
+            return NULL;
+        AVBufferPool* pool = getPool(size);
+        if (!pool)
+            return NULL;
+
+        AVFrame* frame = av_frame_alloc();
+        if (!frame || !(frame->buf[0] = av_buffer_pool_get(pool))) {
+            av_frame_free(&frame);
+            return NULL;
+        }
+        av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, format, width, height, 32);
+        frame->width = width;
+        frame->height = height;
+        frame->format = format;
+        return frame;
+    }
+
+private:
+    struct SizedPool
+    {
+        AVBufferPool* pool;
+        uint64_t lastUse;
+    };
+
+    /* Pools are kept per buffer size, the least recently used one is dropped when full */
+    AVBufferPool* getPool(int size)
+    {
+        auto found = pools.find(size);
+        if (found != pools.end()) {
+            found->second.lastUse = ++useCounter;
+            return found->second.pool;
+        }
+
+        AVBufferPool* pool = av_buffer_pool_init(size, NULL);
+        if (!pool)
+            return NULL;
+
+        if (pools.size() >= MAX_OUTPUT_POOLS) {
+            auto oldest = pools.begin();
+            for (auto it = pools.begin(); it != pools.end(); ++it) {
+                if (it->second.lastUse < oldest->second.lastUse)
+                    oldest = it;
+            }
+            // buffers still in use keep the pool alive until they are returned
+            av_buffer_pool_uninit(&oldest->second.pool);
+            pools.erase(oldest);
+        }
+
+        SizedPool entry = { pool, ++useCounter };
+        pools[size] = entry;
+        return pool;
+    }
+
+    uint64_t useCounter = 0;
+    std::map<int, SizedPool> pools;
+};
+
+struct Worker
+{
+    RoiScaler scaler;
+    OutputFramePool frames;
+};
+
+JobQueue jobQueue;
+InputPool* inputPool;
+std::atomic<long> jobsDone(0), jobsFailed(0), jobsCancelled(0);
+volatile sig_atomic_t stopping = 0;
+int listenFd = -1;
+
+static void send_result(Job* job, int status, int frames, bool warm)
+{
+    DaemonResult result;
+    int64_t now = av_gettime_relative();
+
+    memset(&result, 0, sizeof(result));
+    result.jobId = job->request.jobId;
+    result.status = status;
+    result.frames = frames;
+    result.warmInput = warm;
+    result.queueUs = (job->started ? job->started : now) - job->submitted;
+    result.runUs = job->started ? now - job->started : 0;
+    job->connection->sendResult(result);
+
+    if (status == STATUS_DONE)
+        jobsDone += 1;
+    else if (status == STATUS_CANCELLED)
+        jobsCancelled += 1;
+    else
+        jobsFailed += 1;
+}
+
+/* Seeks to target (stream time base) and decodes the first frame at or after it, the last one at the end */
+static int decode_at(OpenInput* input, int64_t target, AVFrame* frame, const Job* job)
+{
+    AVPacket packet;
+    int ret;
+
+    av_seek_frame(input->input_ctx, input->video_stream, target, AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(input->decoder_ctx);
+
+    while (!job->cancelled) {
+        if (av_read_frame(input->input_ctx, &packet) < 0) {
+            AVFrame* last = av_frame_alloc();
+            avcodec_send_packet(input->decoder_ctx, NULL);
+            ret = -1;
+            while (avcodec_receive_frame(input->decoder_ctx, last) >= 0) {
+                av_frame_unref(frame);
+                av_frame_move_ref(frame, last);
+                ret = 0;
+            }
+            av_frame_free(&last);
+            return ret;
+        }
+
+        if (packet.stream_index == input->video_stream)
+            avcodec_send_packet(input->decoder_ctx, &packet);
+        av_packet_unref(&packet);
+
+        while (avcodec_receive_frame(input->decoder_ctx, frame) >= 0) {
+            if (frame->best_effort_timestamp >= target)
+                return 0;
+            av_frame_unref(frame);
+        }
+    }
+    return -1;
+}
+
+static int64_t stream_target(const OpenInput* input, int64_t timestampMs)
+{
+    int64_t start_time = input->video->start_time != AV_NOPTS_VALUE ? input->video->start_time : 0;
+    return start_time + av_rescale_q(timestampMs, (AVRational){1, 1000}, input->video->time_base);
+}
+
+static int run_thumbnail(const Job* job, OpenInput* input, Worker* worker, int* frames)
+{
+    const DaemonSubmit& request = job->request;
+    AVFrame* frame = av_frame_alloc();
+    int ret = decode_at(input, stream_target(input, request.timestampMs), frame, job);
+
+    if (ret == 0) {
+        AVFrame* out = worker->frames.get(request.width, request.height, AV_PIX_FMT_RGB24);
+        ret = out ? worker->scaler.convert(frame, 0, 0, frame->width, frame->height, out->data, out->linesize,
+                                           request.width, request.height, AV_PIX_FMT_RGB24) : -1;
+        if (ret == 0) {
+            ppm_save(out->data[0], out->linesize[0], request.width, request.height, request.output);
+            *frames = 1;
+        }
+        av_frame_free(&out);
+    }
+
+    av_frame_free(&frame);
+    return ret;
+}
+
+static int run_strip(const Job* job, OpenInput* input, Worker* worker, int* frames)
+{
+    const DaemonSubmit& request = job->request;
+    int64_t durationMs = input->input_ctx->duration != AV_NOPTS_VALUE ? input->input_ctx->duration / 1000 : 0;
+    AVFrame* strip = worker->frames.get(request.width * request.count, request.height, AV_PIX_FMT_RGB24);
+    AVFrame* frame = av_frame_alloc();
+    int ret = strip ? 0 : -1;
+
+    for (int i = 0; i < request.count && ret == 0; ++i) {
+        // each frame at the middle of its part of the clip, converted straight into its place in the strip
+        int64_t timestampMs = durationMs * (2 * i + 1) / (2 * request.count);
+        if ((ret = decode_at(input, stream_target(input, timestampMs), frame, job)) < 0)
+            break;
+
+        uint8_t* dst[4] = { strip->data[0] + (size_t)i * request.width * 3, NULL, NULL, NULL };
+        ret = worker->scaler.convert(frame, 0, 0, frame->width, frame->height, dst, strip->linesize,
+                                     request.width, request.height, AV_PIX_FMT_RGB24);
+        av_frame_unref(frame);
+        *frames += 1;
+    }
+    if (ret == 0)
+        ppm_save(strip->data[0], strip->linesize[0], strip->width, strip->height, request.output);
+
+    av_frame_free(&frame);
+    av_frame_free(&strip);
+    return ret;
+}
+
+static int encode_proxy_frames(const Job* job, OpenInput* input, Worker* worker, ProxyEncoder* proxy,
+                               AVFrame* frame, int* frames)
+{
+    const DaemonSubmit& request = job->request;
+    AVPixelFormat proxyFormat = proxyPixelFormat("mjpeg");
+
+    while (avcodec_receive_frame(input->decoder_ctx, frame) >= 0) {
+        // the encoder may keep a reference, the buffer goes back to the pool when it is done
+        AVFrame* out = worker->frames.get(request.width & ~1, request.height & ~1, proxyFormat);
+        if (!out || worker->scaler.convert(frame, 0, 0, frame->width, frame->height, out->data, out->linesize,
+                                           out->width, out->height, proxyFormat) < 0) {
+            av_frame_free(&out);
+            return -1;
+        }
+        out->pts = frame->best_effort_timestamp;
+        av_frame_unref(frame);
+
+        int ret = encodeProxyFrame(proxy, out);
+        av_frame_free(&out);
+        if (ret < 0)
+            return ret;
+        *frames += 1;
+    }
+    return 0;
+}
+
+static int run_proxy(const Job* job, OpenInput* input, Worker* worker, int* frames)
+{
+    const DaemonSubmit& request = job->request;
+    ProxyEncoder proxy;
+    AVPacket packet;
+    int ret;
+
+    if (openProxyEncoder(&proxy, request.output, "mjpeg", request.width & ~1, request.height & ~1,
+                         input->video->time_base, input->video->avg_frame_rate) < 0) {
+        closeProxyEncoder(&proxy);
+        return -1;
+    }
+
+    int64_t start_time = input->video->start_time != AV_NOPTS_VALUE ? input->video->start_time : 0;
+    av_seek_frame(input->input_ctx, input->video_stream, start_time, AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(input->decoder_ctx);
+
+    AVFrame* frame = av_frame_alloc();
+    ret = 0;
+    while (ret >= 0 && !job->cancelled && av_read_frame(input->input_ctx, &packet) >= 0) {
+        if (packet.stream_index == input->video_stream && avcodec_send_packet(input->decoder_ctx, &packet) >= 0)
+            ret = encode_proxy_frames(job, input, worker, &proxy, frame, frames);
+        av_packet_unref(&packet);
+    }
+    if (ret >= 0 && !job->cancelled) {
+        avcodec_send_packet(input->decoder_ctx, NULL);
+        ret = encode_proxy_frames(job, input, worker, &proxy, frame, frames);
+        if (ret >= 0)
+            ret = encodeProxyFrame(&proxy, NULL);
+    }
+
+    av_frame_free(&frame);
+    closeProxyEncoder(&proxy);
+    if (ret < 0 || job->cancelled)
+        unlink(request.output);
+    return ret < 0 ? -1 : 0;
+}
+
+static int run_job(const Job* job, OpenInput* input, Worker* worker, int* frames)
+{
+    const DaemonSubmit& request = job->request;
+
+    if (request.width <= 0 || request.height <= 0 || request.width > MAX_OUTPUT_SIZE || request.height > MAX_OUTPUT_SIZE)
+        return -1;
+
+    switch (request.jobType) {
+    case JOB_THUMBNAIL:
+        return run_thumbnail(job, input, worker, frames);
+    case JOB_STRIP:
+        if (request.count <= 0 || request.count > MAX_STRIP_FRAMES || request.width * request.count > MAX_OUTPUT_SIZE)
+            return -1;
+        return run_strip(job, input, worker, frames);
+    case JOB_PROXY:
+        return run_proxy(job, input, worker, frames);
+    }
+    return -1;
+}
+
+static void worker_thread(Worker* worker)
+{
+    std::shared_ptr<Job> job;
+
+    while ((job = jobQueue.pop()) != NULL) {
+        int frames = 0;
+        bool warm = false;
+        int status = STATUS_FAILED;
+
+        job->started = av_gettime_relative();
+        OpenInput* input = job->cancelled ? NULL : inputPool->acquire(job->request.input, &warm);
+        if (input) {
+            int ret = run_job(job.get(), input, worker, &frames);
+            status = job->cancelled ? STATUS_CANCELLED : ret < 0 ? STATUS_FAILED : STATUS_DONE;
+            // every job seeks and flushes first, so the input is reusable whatever state this one left it in
+            inputPool->release(input);
+        } else if (job->cancelled) {
+            status = STATUS_CANCELLED;
+        }
+
+        jobQueue.finished(job);
+        send_result(job.get(), status, frames, warm);
+    }
+}
+
+static void connection_thread(int fd)
+{
+    std::shared_ptr<Connection> connection = std::make_shared<Connection>(fd);
+    std::vector<uint8_t> body;
+    int type;
+
+    while ((type = daemonReceive(fd, &body)) >= 0) {
+        if (type == DAEMON_SUBMIT && body.size() == sizeof(DaemonSubmit)) {
+            std::shared_ptr<Job> job = std::make_shared<Job>();
+            memcpy(&job->request, body.data(), sizeof(job->request));
+            job->request.input[DAEMON_MAX_PATH - 1] = '\0';
+            job->request.output[DAEMON_MAX_PATH - 1] = '\0';
+            job->connection = connection;
+            job->cancelled = false;
+            job->submitted = av_gettime_relative();
+            job->started = 0;
+            if (!jobQueue.push(job))
+                send_result(job.get(), STATUS_FAILED, 0, false);
+        } else if (type == DAEMON_CANCEL && body.size() == sizeof(DaemonCancel)) {
+            DaemonCancel cancel;
+            memcpy(&cancel, body.data(), sizeof(cancel));
+            std::shared_ptr<Job> job = jobQueue.cancel(connection.get(), cancel.jobId);
+            if (job)
+                send_result(job.get(), STATUS_CANCELLED, 0, false);
+        } else {
+            fprintf(stderr, "Invalid message, closing the connection\n");
+            break;
+        }
+    }
+
+    jobQueue.cancelAll(connection.get());
+    shutdown(fd, SHUT_RD);
+}
+
+static void handle_stop(int)
+{
+    stopping = 1;
+    shutdown(listenFd, SHUT_RDWR); // wakes up accept
+}
+
+int main(int argc, char *argv[])
+{
+    const char* socketPath = argc >= 2 ? argv[1] : DAEMON_SOCKET;
+    int workerCount = argc >= 3 ? atoi(argv[2]) : std::max(1, (int)std::thread::hardware_concurrency() / 2);
+    int keptInputs = argc >= 4 ? atoi(argv[3]) : 16;
+    struct sockaddr_un address;
+
+    if (workerCount <= 0 || strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Usage: %s [socket path] [workers] [open inputs kept]\n", argv[0]);
+        return -1;
+    }
+    int decoderThreads = std::max(1, (int)std::thread::hardware_concurrency() / workerCount);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    if ((listenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(listenFd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenFd, 64) < 0) {
+        fprintf(stderr, "Cannot listen on '%s'\n", socketPath);
+        return -1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    inputPool = new InputPool(keptInputs, decoderThreads);
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workerCount; ++i) {
+        workers.push_back(new Worker());
+        threads.push_back(std::thread(worker_thread, workers.back()));
+    }
+    fprintf(stdout, "Listening on %s, %d workers with %d decoder threads each\n", socketPath, workerCount, decoderThreads);
+
+    while (!stopping) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        std::thread(connection_thread, fd).detach();
+    }
+
+    jobQueue.close();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    long swsHits = 0, swsMisses = 0;
+    for (Worker* worker : workers) {
+        swsHits += worker->scaler.getHits();
+        swsMisses += worker->scaler.getMisses();
+        delete worker;
+    }
+    fprintf(stdout, "Jobs: %ld done, %ld failed, %ld cancelled\n", (long)jobsDone, (long)jobsFailed, (long)jobsCancelled);
+    fprintf(stdout, "Inputs: %ld reused, %ld opened; SwsContexts: %ld reused, %ld created\n",
+            inputPool->getHits(), inputPool->getMisses(), swsHits, swsMisses);
+
+    delete inputPool;
+    close(listenFd);
+    unlink(socketPath);
+    return 0;
+}
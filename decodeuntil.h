@@ -0,0 +1,57 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+}
+
+/**
+ * Decoding up to a target timestamp after a seek, shared by the seek samples.
+ *
+ * Frames are received into a scratch frame and only moved into the result when they are valid:
+ * avcodec_receive_frame unrefs its frame before it reports EAGAIN or EOF, so receiving straight into the
+ * result would leave it empty when the target lies behind the last frame of the file.
+ */
+
+/*
+ * Decodes from the current position until frame holds the first frame with a timestamp >= target,
+ * the last frame of the file when there is none. Returns the number of decoded frames, -1 if nothing was decoded.
+ */
+static int decode_until(AVFormatContext* input_ctx, AVCodecContext* avctx, int video_stream, int64_t target, AVFrame* frame)
+{
+    AVFrame* decoded = av_frame_alloc();
+    AVPacket packet;
+    int count = 0;
+
+    av_frame_unref(frame);
+    while (1) {
+        if (av_read_frame(input_ctx, &packet) < 0) {
+            // end of file, drain the decoder and keep the last frame
+            avcodec_send_packet(avctx, NULL);
+            while (avcodec_receive_frame(avctx, decoded) >= 0) {
+                count += 1;
+                av_frame_unref(frame);
+                av_frame_move_ref(frame, decoded);
+            }
+            break;
+        }
+
+        bool found = false;
+        if (packet.stream_index == video_stream) {
+            avcodec_send_packet(avctx, &packet);
+            while (!found && avcodec_receive_frame(avctx, decoded) >= 0) {
+                count += 1;
+                av_frame_unref(frame);
+                av_frame_move_ref(frame, decoded);
+                found = frame->best_effort_timestamp >= target;
+            }
+        }
+        av_packet_unref(&packet);
+        if (found)
+            break;
+    }
+
+    av_frame_free(&decoded);
+    return count > 0 ? count : -1;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file
+ * Compares two checksum logs (written with --checksums) of the same input.
+ *
+ * Frames are matched by pts. Reports frames missing from either run, the first frame whose output
+ * (and, if both logs have them and the decoded formats match, decoded planes) differ and the number
+ * of divergent frames. Given the raw frame dumps (--dump) of both runs it also reports the maximum
+ * pixel error of the dumped frames. Exits with 1 when the runs diverge.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include "checksumlog.h"
+
+struct LoggedFrame
+{
+    ChecksumRecord record;
+    ChecksumPlanes planes;
+};
+
+static int read_log(const char* filename, ChecksumLogHeader* header, std::map<int64_t, LoggedFrame>* frames)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open '%s'\n", filename);
+        return -1;
+    }
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, CHECKSUM_LOG_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "'%s' is not a checksum log\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    LoggedFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    while (fread(&frame.record, sizeof(frame.record), 1, file) == 1) {
+        if (header->hasPlanes && fread(&frame.planes, sizeof(frame.planes), 1, file) != 1)
+            break;
+        (*frames)[frame.record.pts] = frame;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int read_dump(const char* filename, ChecksumLogHeader* header, std::map<int64_t, std::vector<uint8_t> >* frames)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open '%s'\n", filename);
+        return -1;
+    }
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, CHECKSUM_DUMP_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "'%s' is not a frame dump\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    int frameSize = av_image_get_buffer_size((AVPixelFormat)header->format, header->width, header->height, 1);
+    int64_t pts;
+    while (fread(&pts, sizeof(pts), 1, file) == 1) {
+        std::vector<uint8_t>& data = (*frames)[pts];
+        data.resize(frameSize);
+        if (fread(data.data(), 1, frameSize, file) != (size_t)frameSize) {
+            frames->erase(pts);
+            break;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    ChecksumLogHeader headerA, headerB;
+    std::map<int64_t, LoggedFrame> a, b;
+
+    if (argc != 3 && argc != 5) {
+        fprintf(stderr, "Usage: %s <checksums A> <checksums B> [<dump A> <dump B>]\n", argv[0]);
+        return -1;
+    }
+    if (read_log(argv[1], &headerA, &a) < 0 || read_log(argv[2], &headerB, &b) < 0)
+        return -1;
+
+    if (headerA.width != headerB.width || headerA.height != headerB.height || headerA.format != headerB.format) {
+        fprintf(stdout, "Different outputs: %dx%d %s vs %dx%d %s\n",
+                headerA.width, headerA.height, av_get_pix_fmt_name((AVPixelFormat)headerA.format),
+                headerB.width, headerB.height, av_get_pix_fmt_name((AVPixelFormat)headerB.format));
+        return 1;
+    }
+
+    long onlyA = 0, onlyB = 0, common = 0, outputDiffs = 0, planeDiffs = 0, planesCompared = 0;
+    const LoggedFrame* firstOutput = NULL;
+    const LoggedFrame* firstPlanes = NULL;
+
+    for (const auto& entry : a) {
+        auto other = b.find(entry.first);
+        if (other == b.end()) {
+            onlyA += 1;
+            continue;
+        }
+        common += 1;
+
+        const LoggedFrame& fa = entry.second;
+        const LoggedFrame& fb = other->second;
+        if (fa.record.outputHash != fb.record.outputHash) {
+            outputDiffs += 1;
+            if (!firstOutput)
+                firstOutput = &fa;
+        }
+
+        if (headerA.hasPlanes && headerB.hasPlanes && fa.planes.planeCount > 0 &&
+            fa.planes.format == fb.planes.format && fa.planes.planeCount == fb.planes.planeCount) {
+            planesCompared += 1;
+            if (memcmp(fa.planes.planeHash, fb.planes.planeHash, sizeof(fa.planes.planeHash)) != 0) {
+                planeDiffs += 1;
+                if (!firstPlanes)
+                    firstPlanes = &fa;
+            }
+        }
+    }
+    for (const auto& entry : b) {
+        if (a.find(entry.first) == a.end())
+            onlyB += 1;
+    }
+
+    fprintf(stdout, "%ld frames in both runs, %ld only in A, %ld only in B\n", common, onlyA, onlyB);
+    if (firstOutput)
+        fprintf(stdout, "Output differs in %ld frames, first at pts %lld (frame %lld of A)\n", outputDiffs,
+                (long long)firstOutput->record.pts, (long long)firstOutput->record.frameNumber);
+    else
+        fprintf(stdout, "Output identical\n");
+    if (planesCompared > 0) {
+        if (firstPlanes)
+            fprintf(stdout, "Decoded planes differ in %ld of %ld frames, first at pts %lld\n", planeDiffs,
+                    planesCompared, (long long)firstPlanes->record.pts);
+        else
+            fprintf(stdout, "Decoded planes identical in %ld frames\n", planesCompared);
+    }
+
+    if (argc == 5) {
+        std::map<int64_t, std::vector<uint8_t> > dumpA, dumpB;
+        ChecksumLogHeader dumpHeaderA, dumpHeaderB;
+
+        if (read_dump(argv[3], &dumpHeaderA, &dumpA) < 0 || read_dump(argv[4], &dumpHeaderB, &dumpB) < 0)
+            return -1;
+
+        int maxError = 0;
+        int64_t maxErrorPts = 0;
+        long comparedFrames = 0, differentBytes = 0;
+        for (const auto& entry : dumpA) {
+            auto other = dumpB.find(entry.first);
+            if (other == dumpB.end() || other->second.size() != entry.second.size())
+                continue;
+            comparedFrames += 1;
+            for (size_t i = 0; i < entry.second.size(); ++i) {
+                int error = abs((int)entry.second[i] - (int)other->second[i]);
+                if (error)
+                    differentBytes += 1;
+                if (error > maxError) {
+                    maxError = error;
+                    maxErrorPts = entry.first;
+                }
+            }
+        }
+        fprintf(stdout, "Dumps: %ld frames compared, %ld samples differ, max pixel error %d", comparedFrames,
+                differentBytes, maxError);
+        if (maxError)
+            fprintf(stdout, " at pts %lld", (long long)maxErrorPts);
+        fprintf(stdout, "\n");
+    }
+
+    return (onlyA || onlyB || outputDiffs || planeDiffs) ? 1 : 0;
+}
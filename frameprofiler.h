@@ -0,0 +1,237 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Per frame decode telemetry: picture type, key frame flag, packet size, slices in the picture, time spent
+ * in avcodec_send_packet / avcodec_receive_frame and the latency from handing in the packet to getting
+ * the frame out, plus a summary per picture type and per slice count.
+ *
+ * Frames are matched to their packet by pts (dts when there is no pts). With frame threading the
+ * decode calls mostly wait for a worker thread, so the per frame cost is only the cost of that
+ * picture when the decoder runs with a single thread, the latency then shows the pipelining.
+ * Slices are counted from the slice NAL units of H.264 / HEVC packets (Annex B or length prefixed),
+ * 0 for other codecs. Slice threading can only spread a picture over as many threads as it has slices.
+ */
+
+struct FrameProfileRecord
+{
+    int64_t frameNumber;
+    int64_t pts;
+    char pictType;
+    bool key;
+    int packetSize;
+    int slices; // slice NAL units in the packet, 0 when not known
+    int64_t sendUs;
+    int64_t receiveUs;
+    int64_t latencyUs;
+    int inFlight; // packets handed in but not yet out of the decoder
+};
+
+class FrameProfiler
+{
+public:
+    FrameProfiler(const AVCodecContext* avctx) : codecId(avctx->codec_id), nalLengthSize(0), maxInFlight(0), unmatched(0)
+    {
+        // avcC / hvcC extradata means length prefixed NAL units instead of start codes
+        if (avctx->extradata_size > 4 && avctx->extradata[0] == 1) {
+            if (codecId == AV_CODEC_ID_H264)
+                nalLengthSize = (avctx->extradata[4] & 3) + 1;
+            else if (codecId == AV_CODEC_ID_HEVC && avctx->extradata_size > 21)
+                nalLengthSize = (avctx->extradata[21] & 3) + 1;
+        }
+    }
+
+    void packetSent(const AVPacket* packet, int64_t sendUs)
+    {
+        int64_t key = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        PendingPacket pending = { packet->size, countSlices(packet), av_gettime_relative(), sendUs };
+        pendingPackets[key] = pending;
+        maxInFlight = std::max(maxInFlight, (int)pendingPackets.size());
+    }
+
+    void frameReceived(const AVFrame* frame, int64_t receiveUs)
+    {
+        int64_t key = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->pkt_dts;
+        FrameProfileRecord record;
+
+        record.frameNumber = records.size();
+        record.pts = frame->best_effort_timestamp;
+        record.pictType = av_get_picture_type_char(frame->pict_type);
+        record.key = (frame->flags & AV_FRAME_FLAG_KEY) != 0;
+        record.receiveUs = receiveUs;
+        record.inFlight = pendingPackets.size();
+
+        std::map<int64_t, PendingPacket>::iterator it = pendingPackets.find(key);
+        if (it != pendingPackets.end()) {
+            record.packetSize = it->second.size;
+            record.slices = it->second.slices;
+            record.sendUs = it->second.sendUs;
+            record.latencyUs = av_gettime_relative() - it->second.sentAt;
+            // output is in presentation order, older packets did not produce a frame
+            pendingPackets.erase(pendingPackets.begin(), ++it);
+        } else {
+            record.packetSize = 0;
+            record.slices = 0;
+            record.sendUs = 0;
+            record.latencyUs = 0;
+            unmatched += 1;
+        }
+        records.push_back(record);
+    }
+
+    int writeLog(const char* filename)
+    {
+        FILE* file = fopen(filename, "w");
+        if (!file) {
+            fprintf(stderr, "Cannot open profile log '%s'\n", filename);
+            return -1;
+        }
+        fprintf(file, "frame,pts,type,key,packet_bytes,slices,send_us,receive_us,latency_us,in_flight\n");
+        for (const FrameProfileRecord& r : records) {
+            fprintf(file, "%lld,%lld,%c,%d,%d,%d,%lld,%lld,%lld,%d\n", (long long)r.frameNumber, (long long)r.pts,
+                    r.pictType, r.key, r.packetSize, r.slices, (long long)r.sendUs, (long long)r.receiveUs,
+                    (long long)r.latencyUs, r.inFlight);
+        }
+        fclose(file);
+        return 0;
+    }
+
+    void printSummary(const AVCodecContext* avctx, AVRational frameRate)
+    {
+        if (records.empty())
+            return;
+
+        fprintf(stdout, "Decode profile, %zu frames, %d decoder threads%s\n", records.size(), avctx->thread_count,
+                (avctx->active_thread_type & FF_THREAD_SLICE) ? " (slice threading)" : "");
+        fprintf(stdout, "type   frames  avg bytes  avg us  p95 us  max us  avg latency us\n");
+
+        const char types[] = { 'I', 'P', 'B', '?' };
+        for (char type : types) {
+            std::vector<int64_t> costs;
+            int64_t bytes = 0, latency = 0;
+            for (const FrameProfileRecord& r : records) {
+                bool other = type == '?' && r.pictType != 'I' && r.pictType != 'P' && r.pictType != 'B';
+                if (r.pictType != type && !other)
+                    continue;
+                costs.push_back(r.sendUs + r.receiveUs);
+                bytes += r.packetSize;
+                latency += r.latencyUs;
+            }
+            if (costs.empty())
+                continue;
+
+            int64_t total = 0;
+            for (int64_t c : costs)
+                total += c;
+            std::sort(costs.begin(), costs.end());
+            size_t n = costs.size();
+            fprintf(stdout, "%c    %8zu %10lld %7lld %7lld %7lld %15lld\n", type, n, (long long)(bytes / n),
+                    (long long)(total / n), (long long)costs[(n - 1) * 95 / 100], (long long)costs.back(),
+                    (long long)(latency / n));
+        }
+
+        // pictures with more slices than slice threads are where slice threading still has headroom
+        std::map<int, std::pair<int64_t, int64_t> > bySlices; // slices -> (frames, total us)
+        for (const FrameProfileRecord& r : records) {
+            if (r.slices > 0) {
+                bySlices[r.slices].first += 1;
+                bySlices[r.slices].second += r.sendUs + r.receiveUs;
+            }
+        }
+        if (!bySlices.empty()) {
+            fprintf(stdout, "slices   frames  avg us\n");
+            for (const std::pair<const int, std::pair<int64_t, int64_t> >& s : bySlices)
+                fprintf(stdout, "%6d %8lld %7lld\n", s.first, (long long)s.second.first,
+                        (long long)(s.second.second / s.second.first));
+        }
+
+        // least squares fit cost = a + b * bytes, the estimate for scheduling a job from its packet sizes
+        double n = records.size(), sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        for (const FrameProfileRecord& r : records) {
+            double x = r.packetSize, y = r.sendUs + r.receiveUs;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            syy += y * y;
+            sxy += x * y;
+        }
+        double covariance = n * sxy - sx * sy;
+        double varianceX = n * sxx - sx * sx, varianceY = n * syy - sy * sy;
+        double slope = varianceX > 0 ? covariance / varianceX : 0;
+        double intercept = (sy - slope * sx) / n;
+        double correlation = varianceX > 0 && varianceY > 0 ? covariance / sqrt(varianceX * varianceY) : 0;
+
+        double fps = frameRate.num > 0 ? av_q2d(frameRate) : 25.0;
+        fprintf(stdout, "Stream %.0f bytes/s at %.3f fps, decode %.0f us/frame\n", sx / n * fps, fps, sy / n);
+        fprintf(stdout, "Packet size vs decode time: r = %.3f, cost = %.1f us + %.3f us/KB\n",
+                correlation, intercept, slope * 1024);
+        fprintf(stdout, "Reorder delay %d frames (has_b_frames), max %d packets in flight, %lld frames without packet\n",
+                avctx->has_b_frames, maxInFlight, (long long)unmatched);
+    }
+
+private:
+    /* Slice NAL units in an H.264 / HEVC packet, 0 for other codecs */
+    int countSlices(const AVPacket* packet) const
+    {
+        if (codecId != AV_CODEC_ID_H264 && codecId != AV_CODEC_ID_HEVC)
+            return 0;
+
+        const uint8_t* p = packet->data;
+        const uint8_t* end = packet->data + packet->size;
+        int slices = 0;
+        while (p < end) {
+            const uint8_t* nal;
+            if (nalLengthSize) {
+                if (end - p < nalLengthSize)
+                    break;
+                uint32_t length = 0;
+                for (int i = 0; i < nalLengthSize; ++i)
+                    length = (length << 8) | p[i];
+                nal = p + nalLengthSize;
+                if (length == 0 || length > (uint32_t)(end - nal))
+                    break;
+                p = nal + length;
+            } else {
+                // next start code, 00 00 01 (a leading zero of 00 00 00 01 belongs to the previous NAL unit)
+                while (end - p >= 3 && !(p[0] == 0 && p[1] == 0 && p[2] == 1))
+                    p += 1;
+                if (end - p <= 3)
+                    break;
+                nal = p + 3;
+                p = nal;
+            }
+            if (codecId == AV_CODEC_ID_H264) {
+                int type = nal[0] & 0x1f;
+                slices += type == 1 || type == 5; // non-IDR / IDR slice
+            } else {
+                slices += ((nal[0] >> 1) & 0x3f) < 32; // VCL NAL units are slice segments
+            }
+        }
+        return slices;
+    }
+
+    struct PendingPacket
+    {
+        int size;
+        int slices;
+        int64_t sentAt;
+        int64_t sendUs;
+    };
+
+    AVCodecID codecId;
+    int nalLengthSize; // 0 for Annex B start codes
+    std::map<int64_t, PendingPacket> pendingPackets;
+    std::vector<FrameProfileRecord> records;
+    int maxInFlight;
+    int64_t unmatched;
+};
@@ -0,0 +1,11 @@
+#pragma once
+#include "boundedqueue.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/**
+ * Bounded queue used to hand frames from the decoding thread to a worker thread.
+ */
+typedef BoundedQueue<AVFrame, av_frame_free> FrameQueue;
@@ -0,0 +1,317 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Random access frame server: "frame at time T" instead of a linear read loop.
+ *
+ * The answer to a request for pts T is the first frame with a timestamp >= T (the last frame after the end),
+ * the same frame the seek samples pick. Format context, decoder and SwsContext stay open between requests and
+ * every request takes the cheapest route from the current decoder position:
+ * the frame already decoded (only converted again if the output geometry changed), decoding forward from the
+ * current position, or a seek to the keyframe before T and decoding forward from there.
+ * Forward decoding is chosen when the keyframe the seek would land on (from the demuxer index) is behind the
+ * current position, or at most forwardLimit ahead of it; without an index the distance to T is used.
+ * A negative forwardLimit seeks for every request, even for the frame already decoded (the baseline to compare with).
+ */
+
+enum FrameRoute
+{
+    ROUTE_CURRENT,        // the decoded frame already is the answer
+    ROUTE_DECODE_FORWARD, // decode on from the current position
+    ROUTE_SEEK_FORWARD,   // seek ahead to a keyframe, then decode
+    ROUTE_SEEK_BACKWARD,  // seek back to a keyframe, then decode
+    ROUTE_COUNT
+};
+
+struct FrameServerStats
+{
+    long requests[ROUTE_COUNT];
+    long decodedFrames;
+    long scaledFrames;
+    long failed;
+};
+
+class FrameServer
+{
+public:
+    FrameServer()
+        : input_ctx(NULL), decoder_ctx(NULL), video(NULL), sws_ctx(NULL), current(NULL), next(NULL), out(NULL)
+    {
+        forwardLimitSeconds = 0.5;
+        close();
+    }
+
+    ~FrameServer()
+    {
+        close();
+    }
+
+    int open(const char* filename)
+    {
+        const AVCodec *decoder = NULL;
+        int ret;
+
+        close();
+        if (avformat_open_input(&input_ctx, filename, NULL, NULL) != 0) {
+            fprintf(stderr, "Cannot open input file '%s'\n", filename);
+            return -1;
+        }
+
+        if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+            fprintf(stderr, "Cannot find input stream information.\n");
+            return -1;
+        }
+
+        ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+        if (ret < 0) {
+            fprintf(stderr, "Cannot find a video stream in the input file\n");
+            return -1;
+        }
+        video_stream = ret;
+        video = input_ctx->streams[video_stream];
+
+        if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+            return AVERROR(ENOMEM);
+        if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+            return -1;
+
+        decoder_ctx->thread_count = 0; // 0 = automatic
+        decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+        if (avcodec_open2(decoder_ctx, decoder, NULL) < 0) {
+            fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+            return -1;
+        }
+
+        current = av_frame_alloc();
+        next = av_frame_alloc();
+        out = av_frame_alloc();
+        setForwardLimit(forwardLimitSeconds);
+
+        // a fresh demuxer reads from the start, forward decoding works without a seek
+        position = getStartTime() - 1;
+        return 0;
+    }
+
+    void close()
+    {
+        av_frame_free(&current);
+        av_frame_free(&next);
+        av_frame_free(&out);
+        sws_freeContext(sws_ctx);
+        sws_ctx = NULL;
+        avcodec_free_context(&decoder_ctx);
+        avformat_close_input(&input_ctx);
+        video = NULL;
+
+        hasFrame = false;
+        eof = false;
+        converted = false;
+        lastRoute = ROUTE_SEEK_FORWARD;
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    /* Maximum forward decode distance (seconds) before seeking is preferred, negative to always seek */
+    void setForwardLimit(double seconds)
+    {
+        forwardLimitSeconds = seconds;
+        if (video)
+            forwardLimit = seconds < 0 ? -1 : av_rescale_q((int64_t)(seconds * 1000), (AVRational){1, 1000}, video->time_base);
+    }
+
+    /*
+     * The frame at pts (stream time base) converted to width x height in format, NULL on failure.
+     * The frame belongs to the server and stays valid until the next call. Its pts is the source frame's.
+     */
+    const AVFrame* getFrame(int64_t pts, int width, int height, AVPixelFormat format)
+    {
+        if (forwardLimit >= 0 && hasFrame && pts > previousPts && (pts <= currentPts || eof)) {
+            lastRoute = ROUTE_CURRENT;
+        } else if (position != INT64_MIN && pts > position && forwardLimit >= 0 && forwardDistance(pts) <= forwardLimit) {
+            lastRoute = ROUTE_DECODE_FORWARD;
+        } else {
+            lastRoute = pts > position ? ROUTE_SEEK_FORWARD : ROUTE_SEEK_BACKWARD;
+            if (seek(pts) < 0) {
+                stats.failed += 1;
+                return NULL;
+            }
+        }
+        stats.requests[lastRoute] += 1;
+
+        if (lastRoute != ROUTE_CURRENT && decodeUntil(pts) < 0) {
+            stats.failed += 1;
+            return NULL;
+        }
+        if (convert(width, height, format) < 0) {
+            stats.failed += 1;
+            return NULL;
+        }
+        return out;
+    }
+
+    int64_t timestampFromMs(int64_t ms) const
+    {
+        return getStartTime() + av_rescale_q(ms, (AVRational){1, 1000}, video->time_base);
+    }
+
+    int64_t getStartTime() const
+    {
+        return video->start_time != AV_NOPTS_VALUE ? video->start_time : 0;
+    }
+
+    int64_t getDurationMs() const
+    {
+        if (video->duration != AV_NOPTS_VALUE)
+            return av_rescale_q(video->duration, video->time_base, (AVRational){1, 1000});
+        return input_ctx->duration != AV_NOPTS_VALUE ? input_ctx->duration / 1000 : 0;
+    }
+
+    const AVStream* getStream() const
+    {
+        return video;
+    }
+
+    FrameRoute getLastRoute() const
+    {
+        return lastRoute;
+    }
+
+    const FrameServerStats& getStats() const
+    {
+        return stats;
+    }
+
+private:
+    static int64_t frameTimestamp(const AVFrame* frame)
+    {
+        return frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    }
+
+    /* Frames decoding forward would decode beyond what a seek to the keyframe before target decodes */
+    int64_t forwardDistance(int64_t target)
+    {
+        int index = av_index_search_timestamp(video, target, AVSEEK_FLAG_BACKWARD);
+        const AVIndexEntry* keyframe = index >= 0 ? avformat_index_get_entry(video, index) : NULL;
+        int64_t landing = keyframe ? keyframe->timestamp : target;
+        return landing > position ? landing - position : 0;
+    }
+
+    int seek(int64_t target)
+    {
+        if (av_seek_frame(input_ctx, video_stream, target, AVSEEK_FLAG_BACKWARD) < 0) {
+            fprintf(stderr, "Seek to %ld failed\n", (long)target);
+            return -1;
+        }
+        avcodec_flush_buffers(decoder_ctx);
+        hasFrame = false;
+        eof = false;
+        position = INT64_MIN;
+        return 0;
+    }
+
+    /* Decodes until the current frame is the first one with a timestamp >= target, or the last one */
+    int decodeUntil(int64_t target)
+    {
+        AVPacket packet;
+        int ret;
+
+        bool afterSeek = !hasFrame;
+        while (!eof) {
+            while ((ret = avcodec_receive_frame(decoder_ctx, next)) >= 0) {
+                AVFrame* decoded = next;
+                next = current;
+                current = decoded;
+                av_frame_unref(next);
+
+                stats.decodedFrames += 1;
+                previousPts = hasFrame ? currentPts : INT64_MIN;
+                currentPts = position = frameTimestamp(current);
+                hasFrame = true;
+                converted = false;
+                if (currentPts >= target) {
+                    // the first frame after a seek is a keyframe at or before target, nothing lies between
+                    if (previousPts == INT64_MIN && afterSeek)
+                        previousPts = currentPts - 1;
+                    return 0;
+                }
+            }
+            if (ret == AVERROR_EOF) {
+                eof = true;
+                break;
+            }
+            if (ret != AVERROR(EAGAIN))
+                return -1;
+
+            if (av_read_frame(input_ctx, &packet) < 0) {
+                avcodec_send_packet(decoder_ctx, NULL);
+                continue;
+            }
+            if (packet.stream_index == video_stream)
+                avcodec_send_packet(decoder_ctx, &packet);
+            av_packet_unref(&packet);
+        }
+
+        if (previousPts == INT64_MIN)
+            previousPts = currentPts - 1;
+        return hasFrame ? 0 : -1;
+    }
+
+    int convert(int width, int height, AVPixelFormat format)
+    {
+        if (converted && out->width == width && out->height == height && out->format == format)
+            return 0;
+
+        sws_ctx = sws_getCachedContext(sws_ctx, current->width, current->height, (AVPixelFormat)current->format,
+                                       width, height, format, SWS_BILINEAR, NULL, NULL, NULL);
+        if (!sws_ctx)
+            return -1;
+
+        if (!out->buf[0] || out->width != width || out->height != height || out->format != format) {
+            av_frame_unref(out);
+            out->width = width;
+            out->height = height;
+            out->format = format;
+            if (av_frame_get_buffer(out, 0) < 0)
+                return -1;
+        }
+
+        sws_scale(sws_ctx, (uint8_t const * const *)current->data,
+                current->linesize, 0, current->height,
+                out->data, out->linesize);
+        out->pts = currentPts;
+        converted = true;
+        stats.scaledFrames += 1;
+        return 0;
+    }
+
+    AVFormatContext* input_ctx;
+    AVCodecContext* decoder_ctx;
+    AVStream* video;
+    int video_stream;
+    struct SwsContext* sws_ctx;
+
+    AVFrame* current; // last decoded frame
+    AVFrame* next;
+    AVFrame* out;     // current converted to the last requested geometry
+
+    bool hasFrame;
+    bool eof;
+    bool converted;
+    int64_t currentPts;
+    int64_t previousPts; // timestamp of the frame decoded before current, requests in between are current
+    int64_t position;    // timestamp of the last decoded frame, INT64_MIN after a seek until a frame is decoded
+
+    double forwardLimitSeconds;
+    int64_t forwardLimit; // in stream time base, -1 to always seek
+    FrameRoute lastRoute;
+    FrameServerStats stats;
+};
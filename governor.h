@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <deque>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Throughput governor: keeps a job at a target frame rate by trading output quality for speed.
+ *
+ * The achieved rate is measured in source frames per second over a sliding window. Below the target
+ * the governor steps one level down the ladder, with headroom it steps one level back up.
+ * A level is held for a minimum time and the window restarts on every change, so every decision
+ * is based on frames processed at the current level only.
+ */
+
+struct QualityLevel
+{
+    const char* name;
+    int swsFlags;
+    AVDiscard skipLoopFilter;
+    AVDiscard skipFrame;
+    int scaleDivisor; // of the output resolution
+};
+
+// cheapest last, every level keeps the savings of the ones above it
+static const QualityLevel qualityLadder[] = {
+    { "bilinear",          SWS_BILINEAR,      AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 1 },
+    { "fast bilinear",     SWS_FAST_BILINEAR, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 1 },
+    { "point",             SWS_POINT,         AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, 1 },
+    { "no loop filter",    SWS_POINT,         AVDISCARD_ALL,     AVDISCARD_DEFAULT, 1 },
+    { "skip non-ref",      SWS_POINT,         AVDISCARD_ALL,     AVDISCARD_NONREF,  1 },
+    { "half resolution",   SWS_POINT,         AVDISCARD_ALL,     AVDISCARD_NONREF,  2 },
+};
+
+#define QUALITY_LEVELS (int)(sizeof(qualityLadder) / sizeof(qualityLadder[0]))
+
+class ThroughputGovernor
+{
+public:
+    ThroughputGovernor(double targetFps, int64_t windowUs = 1000000, int64_t holdUs = 2000000, double headroom = 1.3)
+        : targetFps(targetFps), windowUs(windowUs), holdUs(holdUs), headroom(headroom),
+          level(0), lastChange(AV_NOPTS_VALUE), windowFps(0)
+    {
+    }
+
+    /* Called for every source frame consumed, returns true when the level changed */
+    bool frameDone(int64_t now)
+    {
+        if (lastChange == AV_NOPTS_VALUE)
+            lastChange = now;
+
+        times.push_back(now);
+        while (times.front() < now - windowUs)
+            times.pop_front();
+
+        // not enough of the window filled since the last change
+        if (times.size() < 2 || now - times.front() < windowUs / 2)
+            return false;
+        windowFps = (times.size() - 1) * 1000000.0 / (now - times.front());
+
+        if (now - lastChange < holdUs)
+            return false;
+
+        int next = level;
+        if (windowFps < targetFps && level + 1 < QUALITY_LEVELS)
+            next = level + 1;
+        else if (windowFps > targetFps * headroom && level > 0)
+            next = level - 1;
+        if (next == level)
+            return false;
+
+        level = next;
+        lastChange = now;
+        times.clear();
+        return true;
+    }
+
+    /* Applies the decoder side of the current level, it takes effect from the next packet */
+    void apply(AVCodecContext* avctx) const
+    {
+        avctx->skip_loop_filter = qualityLadder[level].skipLoopFilter;
+        avctx->skip_frame = qualityLadder[level].skipFrame;
+    }
+
+    int getLevel() const
+    {
+        return level;
+    }
+
+    const QualityLevel& current() const
+    {
+        return qualityLadder[level];
+    }
+
+    /* Source frames per second measured over the last window */
+    double getWindowFps() const
+    {
+        return windowFps;
+    }
+
+private:
+    double targetFps;
+    int64_t windowUs;
+    int64_t holdUs;
+    double headroom;
+    int level;
+    int64_t lastChange;
+    double windowFps;
+    std::deque<int64_t> times;
+};
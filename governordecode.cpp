@@ -0,0 +1,213 @@
+/**
+ * @file
+ * Decode with an adaptive throughput governor.
+ *
+ * Runs like swdecode, but keeps the given target rate (source frames per second) on a machine whose
+ * available CPU changes: when the job falls behind it steps down a degradation ladder (cheaper sws
+ * flags, no loop filter, skipped non-reference frames, half output resolution) and steps back up when
+ * there is headroom. Every transition is logged, the quality actually delivered is summarized at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "governor.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+int imageNumber = 0;
+char buf[200];
+
+ThroughputGovernor* governor;
+struct SwsContext* sws_ctx = NULL;
+AVFrame* pFrameRGB;
+
+long deliveredPerLevel[QUALITY_LEVELS];
+int64_t timePerLevel[QUALITY_LEVELS];
+FILE* transitionLog = NULL;
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        const QualityLevel& quality = governor->current();
+        int outWidth = width / quality.scaleDivisor;
+        int outHeight = height / quality.scaleDivisor;
+
+        // only rebuilt when the level changed the flags or the output size
+        sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                       outWidth, outHeight, FORMAT, quality.swsFlags, NULL, NULL, NULL);
+        sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+                frame->linesize, 0, frame->height,
+                pFrameRGB->data, pFrameRGB->linesize);
+
+        imageNumber += 1;
+        deliveredPerLevel[governor->getLevel()] += 1;
+
+        if (imageNumber % 100 == 0) {
+            snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "governordecode", imageNumber);
+            ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], outWidth, outHeight, buf);
+        }
+
+        av_frame_free(&frame);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input file> <target fps> [transition log]\n", argv[0]);
+        return -1;
+    }
+    double targetFps = atof(argv[2]);
+    if (targetFps <= 0) {
+        fprintf(stderr, "Invalid target fps '%s'\n", argv[2]);
+        return -1;
+    }
+    if (argc >= 4 && !(transitionLog = fopen(argv[3], "w"))) {
+        fprintf(stderr, "Cannot open '%s'\n", argv[3]);
+        return -1;
+    }
+
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    // big enough for every level, smaller levels only use the top left part
+    pFrameRGB = allocateFrame(width, height, FORMAT);
+    governor = new ThroughputGovernor(targetFps);
+    governor->apply(decoder_ctx);
+
+    if (transitionLog)
+        fprintf(transitionLog, "# time_s source_frame window_fps from_level to_level\n");
+    printf("Decoder name: %s, target %.1f fps\n", decoder->name, targetFps);
+
+    int64_t start = av_gettime_relative();
+    int64_t levelSince = start;
+    long sourceFrames = 0;
+
+    while (ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index) {
+            ret = decode_write(decoder_ctx, &packet);
+            sourceFrames += 1;
+
+            int64_t now = av_gettime_relative();
+            int from = governor->getLevel();
+            if (governor->frameDone(now)) {
+                int to = governor->getLevel();
+                governor->apply(decoder_ctx);
+                timePerLevel[from] += now - levelSince;
+                levelSince = now;
+
+                fprintf(stdout, "%.2f s, frame %ld: %.1f fps, target %.1f -> level %d '%s' (was %d '%s')\n",
+                        (now - start) / 1000000.0, sourceFrames, governor->getWindowFps(), targetFps,
+                        to, qualityLadder[to].name, from, qualityLadder[from].name);
+                if (transitionLog)
+                    fprintf(transitionLog, "%.3f %ld %.2f %d %d\n", (now - start) / 1000000.0, sourceFrames,
+                            governor->getWindowFps(), from, to);
+            }
+        }
+
+        av_packet_unref(&packet);
+    }
+
+    /* flush the decoder */
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_write(decoder_ctx, &packet);
+    av_packet_unref(&packet);
+
+    int64_t end = av_gettime_relative();
+    timePerLevel[governor->getLevel()] += end - levelSince;
+    double took = (end - start) / 1000000.0;
+
+    fprintf(stdout, "Took %f s, %.1f source fps (target %.1f), delivered %d frames, %.1f fps\n",
+            took, sourceFrames / took, targetFps, imageNumber, imageNumber / took);
+    fprintf(stdout, "level  name               frames   time %%\n");
+    for (int i = 0; i < QUALITY_LEVELS; ++i) {
+        fprintf(stdout, "%5d  %-17s %7ld  %6.1f\n", i, qualityLadder[i].name, deliveredPerLevel[i],
+                100.0 * timePerLevel[i] / (end - start));
+    }
+
+    if (transitionLog)
+        fclose(transitionLog);
+    delete governor;
+    av_freep(&pFrameRGB->opaque);
+    av_frame_free(&pFrameRGB);
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+
+    return 0;
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavformat/avformat.h>
@@ -11,8 +11,12 @@
 #include "debugimage.h"
 
 #include <cassert>
+#include "waveform.h"
+#include "checksumlog.h"
+#include "allocaccounting.h"
 extern "C" {
 #include "helper.h"
+#include "probes.h"
 #include "libavcodec/avcodec.h"
 #include "libswscale/swscale.h"
 #include "libavformat/avformat.h"
@@ -45,6 +49,7 @@ AVFilterGraph *filter_graph = NULL;
 AVBufferRef* real_hw_device_ctx = NULL;
 
 struct SwsContext* sws_ctx;
+ChecksumLog* checksumLog = NULL;
 
 static int hw_decoder_init(AVCodecContext *ctx, const enum AVHWDeviceType type, const char* device)
 {
@@ -169,7 +174,9 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
 
 
 
+    PROBE_TIMER_START(send_packet);
     ret = avcodec_send_packet(avctx, packet);
+    PROBE_TIMED3(send_packet, packet->pts, packet->size);
     if (ret < 0) {
         fprintf(stderr, "Error during decoding\n");
         return ret;
@@ -183,6 +190,7 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
         }
 
 
+        PROBE_TIMER_START(receive_frame);
         ret = avcodec_receive_frame(avctx, frame);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             av_frame_free(&frame);
@@ -192,6 +200,8 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
             fprintf(stderr, "Error while decoding\n");
             return ret;
         } else {
+            PROBE_TIMED3(receive_frame, imageNumber, frame->pts);
+
             if (real_hw_device_ctx == NULL) {
                 real_hw_device_ctx = frame->hw_frames_ctx;
             }
@@ -212,26 +222,37 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
                 filt_frame = av_frame_alloc();
                 ret = av_buffersink_get_frame(buffersink_ctx, filt_frame);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                    av_frame_free(&filt_frame);
                     break;
                 }
                 if (ret < 0) {
                     av_log(NULL, AV_LOG_ERROR, "Error reading from buffersink\n");
+                    av_frame_free(&filt_frame);
                     break;
                 }
                 
                 imageNumber += 1;
+                ALLOC_ACCOUNTING_FRAME();
 
                 AVFrame* pFrameRGB=allocateFrame(400, 300, FORMAT);
+                PROBE_TIMER_START(sws_scale);
                 sws_scale(sws_ctx, (uint8_t const * const *)filt_frame->data,
                         filt_frame->linesize, 0, filt_frame->height,
                         pFrameRGB->data, pFrameRGB->linesize);
+                PROBE_TIMED3(sws_scale, imageNumber, filt_frame->pts);
+                // the decoded frames stay on the GPU, only the output is hashed
+                if (checksumLog)
+                    checksumLog->add(filt_frame->pts, NULL, pFrameRGB->data, pFrameRGB->linesize);
 
                 if (imageNumber % 100 == 0) {
                     snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "hwdecode", imageNumber);
+                    PROBE_TIMER_START(ppm_save);
                     ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], pFrameRGB->width, pFrameRGB->height, buf);
+                    PROBE_TIMED3(ppm_save, imageNumber, pFrameRGB->width * pFrameRGB->height * 3);
                 }
 
-
+                av_freep(&pFrameRGB->opaque);
+                av_frame_free(&pFrameRGB);
 
                 av_frame_free(&filt_frame);
             }
@@ -260,12 +281,27 @@ int main(int argc, char *argv[])
     int i;
 
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <input file> <device>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <input file> <device> [--waveform <peaks file>] [--checksums <log> [--dump <raw file> [from pts]]]\n", argv[0]);
         return -1;
     }
     const char* device = argc >= 2 ? argv[2] : "/dev/dri/renderD128";
     const char* typeName = "vaapi";
     const char* input = argv[1];
+    const char* waveformFile = NULL;
+    const char* checksumFile = NULL;
+    const char* dumpFile = NULL;
+    int64_t dumpFromPts = 0;
+    for (i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--waveform") == 0 && i + 1 < argc)
+            waveformFile = argv[++i];
+        else if (strcmp(argv[i], "--checksums") == 0 && i + 1 < argc)
+            checksumFile = argv[++i];
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpFile = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                dumpFromPts = strtoll(argv[++i], NULL, 10);
+        }
+    }
 
    // av_log_set_level(AV_LOG_TRACE);
 
@@ -328,6 +364,17 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (checksumFile) {
+        checksumLog = new ChecksumLog();
+        if (checksumLog->open(checksumFile, false, 400, 300, FORMAT) < 0 ||
+            (dumpFile && checksumLog->openDump(dumpFile, dumpFromPts) < 0))
+            return -1;
+    }
+
+    WaveformExtractor waveform;
+    if (waveformFile && waveform.open(input_ctx, video_stream) < 0)
+        waveformFile = NULL;
+
 
    long long start = time(NULL);
 
@@ -348,11 +395,15 @@ int main(int argc, char *argv[])
     /* actual decoding and dump the raw data */
     while (ret >= 0) {
       //  fprintf(stdout, "Frame .. \n");
+        PROBE_TIMER_START(packet_read);
         if ((ret = av_read_frame(input_ctx, &packet)) < 0)
             break;
+        PROBE_TIMED4(packet_read, packet.stream_index, packet.pts, packet.size);
 
         if (video_stream == packet.stream_index)
             ret = decode_write(decoder_ctx, &packet);
+        else if (waveformFile && waveform.getStreamIndex() == packet.stream_index)
+            waveform.push(&packet);
 
         av_packet_unref(&packet);
         frames += 1;
@@ -368,6 +419,9 @@ int main(int argc, char *argv[])
     packet.size = 0;
     ret = decode_write(decoder_ctx, &packet);
     av_packet_unref(&packet);
+    if (waveformFile)
+        waveform.finish(waveformFile);
+    delete checksumLog;
 
 
 
@@ -381,6 +435,6 @@ int main(int argc, char *argv[])
     avformat_close_input(&input_ctx);
     av_buffer_unref(&hw_device_ctx);
 
-    return 0;
+    return ALLOC_ACCOUNTING_REPORT();
 }
 }
\ No newline at end of file
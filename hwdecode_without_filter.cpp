@@ -11,8 +11,12 @@
 #include "debugimage.h"
 
 #include <cassert>
+#include "waveform.h"
+#include "checksumlog.h"
+#include "allocaccounting.h"
 extern "C" {
 #include "helper.h"
+#include "probes.h"
 #include "libavcodec/avcodec.h"
 #include "libswscale/swscale.h"
 #include "libavformat/avformat.h"
@@ -41,6 +45,7 @@ AVCodecContext *decoder_ctx;
 AVBufferRef* real_hw_device_ctx = NULL;
 
 struct SwsContext* sws_ctx;
+ChecksumLog* checksumLog = NULL;
     AVStream *video = NULL;
 
 static int hw_decoder_init(AVCodecContext *ctx, const enum AVHWDeviceType type, const char* device)
@@ -124,7 +129,9 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
 
 
 
+    PROBE_TIMER_START(send_packet);
     ret = avcodec_send_packet(avctx, packet);
+    PROBE_TIMED3(send_packet, packet->pts, packet->size);
     if (ret < 0) {
         fprintf(stderr, "Error during decoding\n");
         return ret;
@@ -138,6 +145,7 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
         }
 
 
+        PROBE_TIMER_START(receive_frame);
         ret = avcodec_receive_frame(avctx, frame);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             av_frame_free(&frame);
@@ -147,14 +155,18 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
             fprintf(stderr, "Error while decoding\n");
             return ret;
         } else {
+            PROBE_TIMED3(receive_frame, imageNumber, frame->pts);
+
             if (real_hw_device_ctx == NULL) {
                 real_hw_device_ctx = frame->hw_frames_ctx;
             }
 
+            PROBE_TIMER_START(hwframe_transfer);
             if ((ret = av_hwframe_transfer_data(sw_frame, frame, 0)) < 0) {
                 fprintf(stderr, "Error transferring the data to system memory\n");
                 return -1;
             }
+            PROBE_TIMED3(hwframe_transfer, imageNumber, frame->pts);
 
             if (sws_ctx == NULL) {
                 sws_ctx = sws_getContext(   video->codecpar->width,
@@ -173,16 +185,26 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet)
             tmp_frame = sw_frame;
 
             AVFrame* pFrameRGB=allocateFrame(width, height, FORMAT);
+            PROBE_TIMER_START(sws_scale);
             sws_scale(sws_ctx, (uint8_t const * const *)sw_frame->data,
                     sw_frame->linesize, 0, sw_frame->height,
                     pFrameRGB->data, pFrameRGB->linesize);
+            PROBE_TIMED3(sws_scale, imageNumber, frame->pts);
+            if (checksumLog)
+                checksumLog->add(frame->pts, sw_frame, pFrameRGB->data, pFrameRGB->linesize);
                     
                     
             if (imageNumber % 10 == 0) {
                 snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "hwdecode_without_filters", imageNumber);
+                PROBE_TIMER_START(ppm_save);
                 ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], pFrameRGB->width, pFrameRGB->height, buf);
+                PROBE_TIMED3(ppm_save, imageNumber, pFrameRGB->width * pFrameRGB->height * 3);
             }
             imageNumber += 1;
+            ALLOC_ACCOUNTING_FRAME();
+
+            av_freep(&pFrameRGB->opaque);
+            av_frame_free(&pFrameRGB);
 
         }
 
@@ -205,12 +227,30 @@ int main(int argc, char *argv[])
     int i;
 
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <input file> <device type (ex. vaapi)>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <input file> <device type (ex. vaapi)> [--waveform <peaks file>] [--checksums <log> [--planes] [--dump <raw file> [from pts]]]\n", argv[0]);
         return -1;
     }
     const char* device = argc >= 2 ? argv[2] : "/dev/dri/renderD128";
     const char* typeName = "vaapi";
     const char* input = argv[1];
+    const char* waveformFile = NULL;
+    const char* checksumFile = NULL;
+    const char* dumpFile = NULL;
+    int64_t dumpFromPts = 0;
+    bool hashPlanes = false;
+    for (i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--waveform") == 0 && i + 1 < argc)
+            waveformFile = argv[++i];
+        else if (strcmp(argv[i], "--checksums") == 0 && i + 1 < argc)
+            checksumFile = argv[++i];
+        else if (strcmp(argv[i], "--planes") == 0)
+            hashPlanes = true;
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpFile = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                dumpFromPts = strtoll(argv[++i], NULL, 10);
+        }
+    }
 
    // av_log_set_level(AV_LOG_TRACE);
 
@@ -273,6 +313,17 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (checksumFile) {
+        checksumLog = new ChecksumLog();
+        if (checksumLog->open(checksumFile, hashPlanes, width, height, FORMAT) < 0 ||
+            (dumpFile && checksumLog->openDump(dumpFile, dumpFromPts) < 0))
+            return -1;
+    }
+
+    WaveformExtractor waveform;
+    if (waveformFile && waveform.open(input_ctx, video_stream) < 0)
+        waveformFile = NULL;
+
 
 
    long long start = time(NULL);
@@ -283,11 +334,15 @@ int main(int argc, char *argv[])
     /* actual decoding and dump the raw data */
     while (ret >= 0) {
       //  fprintf(stdout, "Frame .. \n");
+        PROBE_TIMER_START(packet_read);
         if ((ret = av_read_frame(input_ctx, &packet)) < 0)
             break;
+        PROBE_TIMED4(packet_read, packet.stream_index, packet.pts, packet.size);
 
         if (video_stream == packet.stream_index)
             ret = decode_write(decoder_ctx, &packet);
+        else if (waveformFile && waveform.getStreamIndex() == packet.stream_index)
+            waveform.push(&packet);
 
         av_packet_unref(&packet);
         frames += 1;
@@ -303,6 +358,9 @@ int main(int argc, char *argv[])
     packet.size = 0;
     ret = decode_write(decoder_ctx, &packet);
     av_packet_unref(&packet);
+    if (waveformFile)
+        waveform.finish(waveformFile);
+    delete checksumLog;
 
 
 
@@ -316,6 +374,6 @@ int main(int argc, char *argv[])
     avformat_close_input(&input_ctx);
     av_buffer_unref(&hw_device_ctx);
 
-    return 0;
+    return ALLOC_ACCOUNTING_REPORT();
 }
 }
@@ -0,0 +1,221 @@
+/**
+ * @file
+ * Load generator for the decode daemon.
+ *
+ * Every client thread opens its own connection and keeps one job in flight (closed loop), so the number
+ * of clients is the concurrency. Job types are drawn from the given mix with priorities as an editor would
+ * use them (thumbnails 10, strips 5, proxies 0), optionally every Nth job is cancelled right after submitting.
+ * Prints jobs per second and latency percentiles (submit to result) per job type.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/un.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include "daemonprotocol.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+#define JOB_TYPES 3
+
+static const char* jobNames[JOB_TYPES] = { "thumbnail", "strip", "proxy" };
+static const int jobPriorities[JOB_TYPES] = { 10, 5, 0 };
+
+struct TypeStats
+{
+    std::vector<int64_t> latencies; // of completed jobs
+    int64_t queueTime;
+    long done;
+    long failed;
+    long cancelled;
+    long warm;
+};
+
+const char* socketPath = DAEMON_SOCKET;
+const char* input;
+int64_t durationMs;
+int jobsPerClient = 50;
+int weights[JOB_TYPES] = { 90, 10, 0 };
+int cancelEvery = 0;
+
+TypeStats stats[JOB_TYPES];
+std::mutex statsMutex;
+
+static int64_t percentile(std::vector<int64_t>& sorted, double p)
+{
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+static int connect_daemon()
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int pick_type(unsigned int* seed)
+{
+    int total = weights[0] + weights[1] + weights[2];
+    int r = rand_r(seed) % total;
+    for (int i = 0; i < JOB_TYPES; ++i) {
+        if (r < weights[i])
+            return i;
+        r -= weights[i];
+    }
+    return 0;
+}
+
+static void client_thread(int client)
+{
+    unsigned int seed = 1234 + client;
+    std::vector<uint8_t> body;
+    TypeStats local[JOB_TYPES];
+
+    int fd = connect_daemon();
+    if (fd < 0) {
+        fprintf(stderr, "Cannot connect to '%s'\n", socketPath);
+        return;
+    }
+
+    for (int i = 0; i < JOB_TYPES; ++i)
+        local[i].queueTime = local[i].done = local[i].failed = local[i].cancelled = local[i].warm = 0;
+
+    for (int j = 0; j < jobsPerClient; ++j) {
+        DaemonSubmit submit;
+        memset(&submit, 0, sizeof(submit));
+        int type = pick_type(&seed);
+
+        submit.jobId = j;
+        submit.jobType = type;
+        submit.priority = jobPriorities[type];
+        submit.timestampMs = durationMs > 0 ? rand_r(&seed) % durationMs : 0;
+        submit.count = 10;
+        submit.width = type == JOB_STRIP ? 160 : type == JOB_PROXY ? 640 : 400;
+        submit.height = type == JOB_STRIP ? 90 : type == JOB_PROXY ? 360 : 300;
+        strncpy(submit.input, input, sizeof(submit.input) - 1);
+        snprintf(submit.output, sizeof(submit.output), "/tmp/loadgen_%d_%s.%s", client, jobNames[type],
+                 type == JOB_PROXY ? "mkv" : "ppm");
+
+        int64_t start = av_gettime_relative();
+        if (daemonSend(fd, DAEMON_SUBMIT, &submit, sizeof(submit)) < 0)
+            break;
+        if (cancelEvery > 0 && j % cancelEvery == cancelEvery - 1) {
+            DaemonCancel cancel = { submit.jobId };
+            daemonSend(fd, DAEMON_CANCEL, &cancel, sizeof(cancel));
+        }
+
+        DaemonResult result;
+        if (daemonReceive(fd, &body) != DAEMON_RESULT || body.size() != sizeof(result))
+            break;
+        memcpy(&result, body.data(), sizeof(result));
+        int64_t latency = av_gettime_relative() - start;
+
+        TypeStats& s = local[type];
+        if (result.status == STATUS_DONE) {
+            s.done += 1;
+            s.latencies.push_back(latency);
+            s.queueTime += result.queueUs;
+            s.warm += result.warmInput;
+        } else if (result.status == STATUS_CANCELLED) {
+            s.cancelled += 1;
+        } else {
+            s.failed += 1;
+        }
+    }
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (int i = 0; i < JOB_TYPES; ++i) {
+        stats[i].latencies.insert(stats[i].latencies.end(), local[i].latencies.begin(), local[i].latencies.end());
+        stats[i].queueTime += local[i].queueTime;
+        stats[i].done += local[i].done;
+        stats[i].failed += local[i].failed;
+        stats[i].cancelled += local[i].cancelled;
+        stats[i].warm += local[i].warm;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [clients=4] [jobs per client=50] [thumbnail:strip:proxy mix=90:10:0] "
+                        "[cancel every Nth job=0] [socket path]\n", argv[0]);
+        return -1;
+    }
+    input = argv[1];
+    int clients = argc >= 3 ? atoi(argv[2]) : 4;
+    if (argc >= 4)
+        jobsPerClient = atoi(argv[3]);
+    if (argc >= 5 && (sscanf(argv[4], "%d:%d:%d", &weights[0], &weights[1], &weights[2]) != 3 ||
+                      weights[0] + weights[1] + weights[2] <= 0)) {
+        fprintf(stderr, "Invalid job mix '%s'\n", argv[4]);
+        return -1;
+    }
+    if (argc >= 6)
+        cancelEvery = atoi(argv[5]);
+    if (argc >= 7)
+        socketPath = argv[6];
+
+    // the daemon needs an absolute path, it does not run in our directory
+    char* absolute = realpath(input, NULL);
+    if (!absolute || avformat_open_input(&input_ctx, absolute, NULL, NULL) != 0 ||
+        avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", input);
+        return -1;
+    }
+    input = absolute;
+    durationMs = input_ctx->duration != AV_NOPTS_VALUE ? input_ctx->duration / 1000 : 0;
+    avformat_close_input(&input_ctx);
+
+    for (int i = 0; i < JOB_TYPES; ++i)
+        stats[i].queueTime = stats[i].done = stats[i].failed = stats[i].cancelled = stats[i].warm = 0;
+
+    int64_t start = av_gettime_relative();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+        threads.push_back(std::thread(client_thread, i));
+    for (std::thread& thread : threads)
+        thread.join();
+    double took = (av_gettime_relative() - start) / 1000000.0;
+
+    long done = 0;
+    for (int i = 0; i < JOB_TYPES; ++i)
+        done += stats[i].done;
+    fprintf(stdout, "%d clients, %ld jobs done in %.2f s: %.1f jobs/s\n", clients, done, took, done / took);
+
+    fprintf(stdout, "%-10s %6s %6s %9s %9s %9s %9s %9s %9s %6s\n", "type", "done", "failed", "cancelled",
+            "p50 ms", "p90 ms", "p99 ms", "max ms", "queue ms", "warm%");
+    for (int i = 0; i < JOB_TYPES; ++i) {
+        TypeStats& s = stats[i];
+        if (s.done + s.failed + s.cancelled == 0)
+            continue;
+        fprintf(stdout, "%-10s %6ld %6ld %9ld", jobNames[i], s.done, s.failed, s.cancelled);
+        if (!s.latencies.empty()) {
+            std::sort(s.latencies.begin(), s.latencies.end());
+            fprintf(stdout, " %9.1f %9.1f %9.1f %9.1f %9.1f %6.0f", percentile(s.latencies, 0.5) / 1000.0,
+                    percentile(s.latencies, 0.9) / 1000.0, percentile(s.latencies, 0.99) / 1000.0,
+                    s.latencies.back() / 1000.0, s.queueTime / 1000.0 / s.done, 100.0 * s.warm / s.done);
+        }
+        fprintf(stdout, "\n");
+    }
+
+    free(absolute);
+    return 0;
+}
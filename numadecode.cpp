@@ -0,0 +1,371 @@
+/**
+ * @file
+ * Decode pipeline with thread placement for multi-socket machines.
+ *
+ * The main thread demuxes and feeds the decoder, scaler threads convert the decoded frames to rgb24 at the
+ * source size and a writer thread writes them out in decode order (to /dev/null by default). Decoder workers (libavcodec's
+ * own threads), scaler threads and the I/O threads (demuxer and writer) can each be pinned to a CPU set.
+ * Every scaler allocates its output pool itself after pinning, so the pages land on its node (first touch).
+ * Reports throughput, where sampled frame buffers are compared to the thread using them, node load misses
+ * (loads served by a remote node) and the numastat allocation counters, unpinned and pinned with --compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include "affinity.h"
+#include "framequeue.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+struct Placement
+{
+    bool pinned;
+    cpu_set_t decoder;
+    cpu_set_t scaler;
+    cpu_set_t io;
+};
+
+struct RunResult
+{
+    long frames;
+    double seconds;
+    long localPages;  // sampled frame buffers on the node of the thread reading them
+    long remotePages;
+    long long nodeLoads;
+    long long nodeLoadMisses;
+    NumaStat numaStat; // difference over the run
+};
+
+int scalerCount = 2;
+const char* outputFile = "/dev/null";
+
+std::atomic<long> localPages, remotePages;
+
+/* Counts whether the buffer is on the node of the calling thread */
+static void sample_placement(const void* data)
+{
+    int node = pageNode(data);
+    if (node < 0)
+        return;
+    if (node == currentNode())
+        localPages += 1;
+    else
+        remotePages += 1;
+}
+
+static void scaler_thread(const Placement* placement, FrameQueue* decoded, FrameQueue* converted)
+{
+    struct SwsContext* sws_ctx = NULL;
+    AVBufferPool* pool = NULL;
+    int poolSize = 0;
+    long frames = 0;
+    AVFrame* frame;
+
+    if (placement->pinned)
+        pinCurrentThread(&placement->scaler);
+
+    while ((frame = decoded->pop()) != NULL) {
+        // decoded by another thread, possibly on another node
+        if (frames++ % 50 == 0)
+            sample_placement(frame->data[0]);
+
+        int size = av_image_get_buffer_size(FORMAT, frame->width, frame->height, 32);
+        if (size != poolSize) {
+            // buffers are allocated in this (pinned) thread, av_buffer_pool_get calls av_buffer_alloc here
+            av_buffer_pool_uninit(&pool);
+            pool = av_buffer_pool_init(size, NULL);
+            poolSize = size;
+        }
+
+        AVFrame* out = av_frame_alloc();
+        out->buf[0] = av_buffer_pool_get(pool);
+        av_image_fill_arrays(out->data, out->linesize, out->buf[0]->data, FORMAT, frame->width, frame->height, 32);
+        out->width = frame->width;
+        out->height = frame->height;
+        out->format = FORMAT;
+        out->opaque = frame->opaque; // sequence number, the scalers finish out of order
+
+        sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                       frame->width, frame->height, FORMAT, SWS_BILINEAR, NULL, NULL, NULL);
+        sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+                frame->linesize, 0, frame->height,
+                out->data, out->linesize);
+        av_frame_free(&frame);
+
+        converted->push(out);
+    }
+
+    av_buffer_pool_uninit(&pool);
+    sws_freeContext(sws_ctx);
+}
+
+static void writer_thread(const Placement* placement, FrameQueue* converted, FILE* output)
+{
+    std::map<intptr_t, AVFrame*> pending; // converted ahead of the next frame to write
+    intptr_t next = 0;
+    AVFrame* frame;
+
+    if (placement->pinned)
+        pinCurrentThread(&placement->io);
+
+    while ((frame = converted->pop()) != NULL) {
+        pending[(intptr_t)frame->opaque] = frame;
+
+        for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it), ++next) {
+            frame = it->second;
+            if (next % 50 == 0)
+                sample_placement(frame->data[0]);
+            for (int y = 0; y < frame->height; ++y)
+                fwrite(frame->data[0] + (size_t)y * frame->linesize[0], 1, frame->width * 3, output);
+            av_frame_free(&frame);
+        }
+    }
+
+    // nothing is left unless frames went missing
+    for (auto& entry : pending)
+        av_frame_free(&entry.second);
+}
+
+static int decode_packet(AVCodecContext* avctx, AVPacket* packet, FrameQueue* decoded, long* frames)
+{
+    int ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        AVFrame* frame = av_frame_alloc();
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+        frame->opaque = (void*)(intptr_t)*frames; // sequence number for the writer
+        *frames += 1;
+        decoded->push(frame);
+    }
+}
+
+static int run(const char* filename, const Placement* placement, const cpu_set_t* original, RunResult* result)
+{
+    AVFormatContext *input_ctx = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    int video_stream, ret;
+    NodeLoadCounter counter;
+    NumaStat before, after;
+
+    memset(result, 0, sizeof(*result));
+    localPages = 0;
+    remotePages = 0;
+
+    FILE* output = fopen(outputFile, "wb");
+    if (!output) {
+        fprintf(stderr, "Cannot open '%s'\n", outputFile);
+        return -1;
+    }
+
+    if (avformat_open_input(&input_ctx, filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", filename);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    if (avcodec_parameters_to_context(decoder_ctx, input_ctx->streams[video_stream]->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    // counts every thread created from here on, the decoder workers included
+    counter.start();
+    readNumaStat(&before);
+
+    // the decoder workers are created in avcodec_open2 and inherit the affinity of this thread
+    if (placement->pinned)
+        pinCurrentThread(&placement->decoder);
+    if (avcodec_open2(decoder_ctx, decoder, NULL) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+    if (placement->pinned)
+        pinCurrentThread(&placement->io);
+
+    FrameQueue decoded(16);
+    FrameQueue converted(16);
+    std::vector<std::thread> scalers;
+    for (int i = 0; i < scalerCount; ++i)
+        scalers.push_back(std::thread(scaler_thread, placement, &decoded, &converted));
+    std::thread writer(writer_thread, placement, &converted, output);
+
+    int64_t start = av_gettime_relative();
+
+    while (ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index)
+            ret = decode_packet(decoder_ctx, &packet, &decoded, &result->frames);
+
+        av_packet_unref(&packet);
+    }
+
+    /* flush the decoder */
+    decode_packet(decoder_ctx, NULL, &decoded, &result->frames);
+
+    decoded.close();
+    for (std::thread& scaler : scalers)
+        scaler.join();
+    converted.close();
+    writer.join();
+    result->seconds = (av_gettime_relative() - start) / 1000000.0;
+
+    // the decoder workers exit here, only then their counts are added
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    fclose(output);
+
+    readNumaStat(&after);
+    counter.read(&result->nodeLoads, &result->nodeLoadMisses);
+    result->numaStat.numaHit = after.numaHit - before.numaHit;
+    result->numaStat.numaMiss = after.numaMiss - before.numaMiss;
+    result->numaStat.localNode = after.localNode - before.localNode;
+    result->numaStat.otherNode = after.otherNode - before.otherNode;
+    result->localPages = localPages;
+    result->remotePages = remotePages;
+
+    pinCurrentThread(original);
+    return 0;
+}
+
+static void print_result(const char* name, const RunResult& result)
+{
+    fprintf(stdout, "%-9s %6ld frames %7.2f s %8.1f fps", name, result.frames, result.seconds,
+            result.seconds > 0 ? result.frames / result.seconds : 0);
+
+    if (result.localPages + result.remotePages > 0)
+        fprintf(stdout, ", buffers local %.0f%%", 100.0 * result.localPages / (result.localPages + result.remotePages));
+    else
+        fprintf(stdout, ", buffers local n/a");
+
+    if (result.nodeLoads > 0)
+        fprintf(stdout, ", node loads %lld, remote %lld (%.1f%%)", result.nodeLoads, result.nodeLoadMisses,
+                100.0 * result.nodeLoadMisses / result.nodeLoads);
+    else
+        fprintf(stdout, ", node loads n/a");
+
+    fprintf(stdout, ", pages allocated local %lld remote %lld\n", result.numaStat.localNode, result.numaStat.otherNode);
+}
+
+int main(int argc, char *argv[])
+{
+    Placement placement;
+    Placement unpinned;
+    cpu_set_t original;
+    bool compare = false;
+    RunResult result;
+    int i;
+
+    memset(&placement, 0, sizeof(placement));
+    memset(&unpinned, 0, sizeof(unpinned));
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [--node N] [--decoder-cpus list] [--scaler-cpus list] [--io-cpus list] "
+                        "[--scalers N] [--output file] [--compare]\n", argv[0]);
+        return -1;
+    }
+
+    sched_getaffinity(0, sizeof(original), &original);
+    placement.decoder = placement.scaler = placement.io = original;
+
+    for (i = 2; i < argc; ++i) {
+        cpu_set_t* set = NULL;
+        char nodeList[32];
+        const char* list = i + 1 < argc ? argv[i + 1] : "";
+
+        if (strcmp(argv[i], "--node") == 0 && i + 1 < argc) {
+            snprintf(nodeList, sizeof(nodeList), "node:%s", argv[++i]);
+            if (parseCpuList(nodeList, &placement.decoder) < 0) {
+                fprintf(stderr, "Unknown NUMA node '%s'\n", argv[i]);
+                return -1;
+            }
+            placement.scaler = placement.io = placement.decoder;
+            placement.pinned = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--decoder-cpus") == 0)
+            set = &placement.decoder;
+        else if (strcmp(argv[i], "--scaler-cpus") == 0)
+            set = &placement.scaler;
+        else if (strcmp(argv[i], "--io-cpus") == 0)
+            set = &placement.io;
+        else if (strcmp(argv[i], "--scalers") == 0 && i + 1 < argc)
+            scalerCount = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            outputFile = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0)
+            compare = true;
+
+        if (set) {
+            if (i + 1 >= argc || parseCpuList(list, set) < 0) {
+                fprintf(stderr, "Invalid CPU list '%s'\n", list);
+                return -1;
+            }
+            placement.pinned = true;
+            i += 1;
+        }
+    }
+
+    int nodes = numaNodeCount();
+    fprintf(stdout, "%d NUMA node%s, %d CPUs usable, %d scaler threads\n", nodes, nodes > 1 ? "s" : "",
+            CPU_COUNT(&original), scalerCount);
+    if (nodes == 1)
+        fprintf(stdout, "Single node: no cross-node traffic possible, pinning only changes CPU placement\n");
+
+    if (compare || !placement.pinned) {
+        if (run(argv[1], &unpinned, &original, &result) < 0)
+            return -1;
+        print_result("unpinned", result);
+    }
+    if (placement.pinned) {
+        if (run(argv[1], &placement, &original, &result) < 0)
+            return -1;
+        print_result("pinned", result);
+    }
+
+    return 0;
+}
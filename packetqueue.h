@@ -0,0 +1,11 @@
+#pragma once
+#include "boundedqueue.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/**
+ * Bounded queue used to hand packets from the demuxing thread to a decoder thread.
+ */
+typedef BoundedQueue<AVPacket, av_packet_free> PacketQueue;
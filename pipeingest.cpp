@@ -0,0 +1,216 @@
+/**
+ * @file
+ * Streaming ingest from stdin or a FIFO.
+ *
+ * Same decode and scale as swdecode, but the input is read by a dedicated thread into a large
+ * lock-free ring (see prefetchring.h), which is exposed to libavformat through a custom AVIOContext.
+ * Bursty producers (e.g. MPEG-TS from a capture process) are absorbed by the ring.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include "prefetchring.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/imgutils.h>
+}
+
+int imageNumber = 0;
+char buf[200];
+
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+#define AVIO_BUFFER_SIZE (64 * 1024)
+
+static int read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+    PrefetchRing* ring = (PrefetchRing*)opaque;
+    int size = ring->read(buf, buf_size);
+
+    if (size == 0)
+        return AVERROR_EOF;
+    return size;
+}
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsContext* sws_ctx)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        AVFrame* pFrameRGB=allocateFrame(400, 300, FORMAT);
+
+        sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+                frame->linesize, 0, frame->height,
+                pFrameRGB->data, pFrameRGB->linesize);
+
+        imageNumber += 1;
+
+        if (imageNumber % 100 == 0) {
+            snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "pipeingest", imageNumber);
+            ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], pFrameRGB->width, pFrameRGB->height, buf);
+        }
+
+        av_freep(&pFrameRGB->opaque);
+        av_frame_free(&pFrameRGB);
+        av_frame_free(&frame);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    AVIOContext *avio_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <- for stdin | FIFO path> [ring size in MB]\n", argv[0]);
+        return -1;
+    }
+    size_t ringSize = (argc >= 3 ? atol(argv[2]) : 64) * 1024 * 1024;
+
+    int fd = strcmp(argv[1], "-") == 0 ? 0 : open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open input '%s'\n", argv[1]);
+        return -1;
+    }
+    // larger kernel pipe buffer, fails harmlessly on regular files
+    fcntl(fd, F_SETPIPE_SZ, 1024 * 1024);
+
+    PrefetchRing ring(ringSize);
+    ring.start(fd);
+
+    uint8_t* avio_buffer = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+    avio_ctx = avio_alloc_context(avio_buffer, AVIO_BUFFER_SIZE, 0, &ring, read_packet, NULL, NULL);
+    if (!avio_ctx)
+        return AVERROR(ENOMEM);
+
+    input_ctx = avformat_alloc_context();
+    input_ctx->pb = avio_ctx;
+    input_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    if (avformat_open_input(&input_ctx, NULL, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    av_dump_format(input_ctx, 0, argv[1], 0);
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
+                                decoder_ctx->height,
+                                decoder_ctx->pix_fmt,
+                                400,
+                                300,
+                                FORMAT,
+                                SWS_BILINEAR,
+                                NULL,
+                                NULL,
+                                NULL
+                            );
+
+    printf("Decoder name: %s, ring %zu MB\n", decoder->name, ring.getCapacity() / (1024 * 1024));
+
+   long long start = time(NULL);
+   long frames = 0;
+
+    while (ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index)
+            ret = decode_write(decoder_ctx, &packet, sws_ctx);
+
+        av_packet_unref(&packet);
+        frames += 1;
+        if (frames % 30 == 0)  {
+            long long end = time(NULL);
+            int took = (end - start);
+            fprintf(stdout, "FPS %f, ring fill %.1f%%, underruns %llu\n", frames / (double)took,
+                    100.0 * ring.fillLevel() / ring.getCapacity(), (unsigned long long)ring.getUnderruns());
+        }
+    }
+
+    /* flush the decoder */
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_write(decoder_ctx, &packet, sws_ctx);
+    av_packet_unref(&packet);
+
+   long long end = time(NULL);
+   int took = (end - start);
+   fprintf(stdout, "Took %d\n", took);
+   fprintf(stdout, "FPS %f\n", frames / (double)took);
+   fprintf(stdout, "Ingested %.1f MB, max ring fill %.1f%%, underruns %llu\n",
+           ring.totalBytes() / (1024.0 * 1024.0), 100.0 * ring.getMaxFill() / ring.getCapacity(),
+           (unsigned long long)ring.getUnderruns());
+
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    av_freep(&avio_ctx->buffer);
+    avio_context_free(&avio_ctx);
+    ring.stop();
+    if (fd != 0)
+        close(fd);
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Single producer / single consumer byte ring filled from a file descriptor by a dedicated reader thread.
+ *
+ * The reader thread reads straight into the free part of the ring, the consumer (the AVIOContext
+ * read callback) copies out of it. Positions are only ever increased and published with
+ * release/acquire atomics, no lock is taken on either side.
+ * A bursty producer on the other side of the pipe is absorbed by the ring instead of stalling the decoder.
+ */
+class PrefetchRing
+{
+public:
+    /* capacity is rounded up to a power of two */
+    explicit PrefetchRing(size_t requestedCapacity)
+        : writePos(0), readPos(0), eof(false), stopping(false), underruns(0), maxFill(0), inUnderrun(false)
+    {
+        capacity = 1;
+        while (capacity < requestedCapacity)
+            capacity <<= 1;
+        mask = capacity - 1;
+        buffer.resize(capacity);
+    }
+
+    ~PrefetchRing()
+    {
+        stop();
+    }
+
+    void start(int fd)
+    {
+        this->fd = fd;
+        reader = std::thread(&PrefetchRing::readerLoop, this);
+    }
+
+    void stop()
+    {
+        stopping.store(true);
+        if (reader.joinable())
+            reader.join();
+    }
+
+    /* Blocks until data is available, returns 0 at end of stream */
+    int read(uint8_t* dst, int size)
+    {
+        int spins = 0;
+
+        while (1) {
+            uint64_t r = readPos.load(std::memory_order_relaxed);
+            uint64_t w = writePos.load(std::memory_order_acquire);
+            uint64_t available = w - r;
+
+            if (available == 0) {
+                if (eof.load(std::memory_order_acquire) && writePos.load(std::memory_order_acquire) == r)
+                    return 0;
+                // waiting for the very first bytes is startup, not an underrun
+                if (!inUnderrun && r > 0) {
+                    inUnderrun = true;
+                    underruns.fetch_add(1, std::memory_order_relaxed);
+                }
+                waitBriefly(spins++);
+                continue;
+            }
+            inUnderrun = false;
+
+            size_t n = std::min<uint64_t>(available, (uint64_t)size);
+            size_t offset = r & mask;
+            size_t first = std::min(n, capacity - offset);
+            memcpy(dst, &buffer[offset], first);
+            memcpy(dst + first, &buffer[0], n - first);
+
+            readPos.store(r + n, std::memory_order_release);
+            return (int)n;
+        }
+    }
+
+    size_t fillLevel() const
+    {
+        return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    /* Number of times the consumer found the ring empty while the stream was still running */
+    uint64_t getUnderruns() const
+    {
+        return underruns.load(std::memory_order_relaxed);
+    }
+
+    size_t getMaxFill() const
+    {
+        return maxFill.load(std::memory_order_relaxed);
+    }
+
+    uint64_t totalBytes() const
+    {
+        return writePos.load(std::memory_order_acquire);
+    }
+
+private:
+    static void waitBriefly(int spins)
+    {
+        if (spins < 64)
+            sched_yield();
+        else
+            usleep(50);
+    }
+
+    void readerLoop()
+    {
+        int spins = 0;
+
+        while (!stopping.load(std::memory_order_relaxed)) {
+            uint64_t w = writePos.load(std::memory_order_relaxed);
+            uint64_t r = readPos.load(std::memory_order_acquire);
+            size_t free = capacity - (w - r);
+
+            if (free == 0) {
+                waitBriefly(spins++);
+                continue;
+            }
+            spins = 0;
+
+            size_t offset = w & mask;
+            size_t chunk = std::min(std::min(free, capacity - offset), (size_t)(1 << 20));
+
+            // poll with timeout, so stop() is not stuck behind a blocking read of an idle pipe
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 100) == 0)
+                continue;
+
+            ssize_t n = ::read(fd, &buffer[offset], chunk);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+
+            writePos.store(w + n, std::memory_order_release);
+
+            size_t fill = (w + n) - r;
+            if (fill > maxFill.load(std::memory_order_relaxed))
+                maxFill.store(fill, std::memory_order_relaxed);
+        }
+        eof.store(true, std::memory_order_release);
+    }
+
+    std::vector<uint8_t> buffer;
+    size_t capacity;
+    size_t mask;
+    int fd;
+    std::thread reader;
+
+    alignas(64) std::atomic<uint64_t> writePos;
+    alignas(64) std::atomic<uint64_t> readPos;
+    std::atomic<bool> eof;
+    std::atomic<bool> stopping;
+    std::atomic<uint64_t> underruns;
+    std::atomic<size_t> maxFill;
+    bool inUnderrun;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * USDT (sys/sdt.h) static tracepoints of the decode loops, provider "ffmpeg_sample".
+ *
+ * Every probe has a semaphore: it is zero unless a tracer (bpftrace, perf) is attached, so a disabled
+ * probe is a nop plus one predictable branch, and the timestamps for the duration arguments are
+ * only taken while somebody listens. Without sys/sdt.h (systemtap-sdt-dev) the probes compile to nothing.
+ * The semaphores are defined here, so include it from a single translation unit per program.
+ *
+ *   packet_read      (stream_index, pts, size, duration_ns)
+ *   send_packet      (pts, size, duration_ns)
+ *   receive_frame    (frame_number, pts, duration_ns)
+ *   hwframe_transfer (frame_number, pts, duration_ns)
+ *   sws_scale        (frame_number, pts, duration_ns)
+ *   ppm_save         (frame_number, bytes, duration_ns)
+ *
+ * See the bpftrace directory for ready made scripts.
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SDT 1
+#endif
+#endif
+
+#ifdef HAVE_SDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE_SEMAPHORE(name) \
+    __extension__ unsigned short ffmpeg_sample_##name##_semaphore __attribute__((unused)) __attribute__((section(".probes")))
+
+PROBE_SEMAPHORE(packet_read);
+PROBE_SEMAPHORE(send_packet);
+PROBE_SEMAPHORE(receive_frame);
+PROBE_SEMAPHORE(hwframe_transfer);
+PROBE_SEMAPHORE(sws_scale);
+PROBE_SEMAPHORE(ppm_save);
+
+#define PROBE_ENABLED(name) __builtin_expect(ffmpeg_sample_##name##_semaphore != 0, 0)
+#define PROBE3(name, a, b, c) do { if (PROBE_ENABLED(name)) DTRACE_PROBE3(ffmpeg_sample, name, a, b, c); } while (0)
+#define PROBE4(name, a, b, c, d) do { if (PROBE_ENABLED(name)) DTRACE_PROBE4(ffmpeg_sample, name, a, b, c, d); } while (0)
+
+#else
+
+#define PROBE_ENABLED(name) 0
+#define PROBE3(name, a, b, c) do { } while (0)
+#define PROBE4(name, a, b, c, d) do { } while (0)
+
+#endif
+
+static inline int64_t probe_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Start time of a timed probe, the clock is only read while the probe is enabled */
+#define PROBE_TIMER_START(name) int64_t name##_probe_start = PROBE_ENABLED(name) ? probe_clock() : 0
+#define PROBE_ELAPSED(name) (probe_clock() - name##_probe_start)
+
+/*
+ * Timed probes, the duration since PROBE_TIMER_START is the last argument. A tracer that attached after the
+ * timer was started finds no start time, that call is skipped instead of reporting the time since boot.
+ */
+#define PROBE_TIMED3(name, a, b) \
+    do { if (name##_probe_start != 0) PROBE3(name, a, b, PROBE_ELAPSED(name)); } while (0)
+#define PROBE_TIMED4(name, a, b, c) \
+    do { if (name##_probe_start != 0) PROBE4(name, a, b, c, PROBE_ELAPSED(name)); } while (0)
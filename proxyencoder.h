@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+/**
+ * All-intra, low resolution proxy writer.
+ * Every frame is encoded as a keyframe (mjpeg or ffv1), so any frame of the proxy decodes on its own.
+ * Timestamps are kept in the time base of the source stream, so proxy pts match the original.
+ */
+struct ProxyEncoder
+{
+    AVFormatContext* output_ctx;
+    AVCodecContext* encoder_ctx;
+    AVStream* stream;
+    AVPacket* packet;
+};
+
+static AVPixelFormat proxyPixelFormat(const char* codecName)
+{
+    if (strcmp(codecName, "mjpeg") == 0) {
+        return AV_PIX_FMT_YUVJ420P;
+    }
+    return AV_PIX_FMT_YUV420P;
+}
+
+static int openProxyEncoder(ProxyEncoder* proxy, const char* filename, const char* codecName,
+                            int width, int height, AVRational time_base, AVRational frame_rate)
+{
+    int ret;
+    const AVCodec* encoder = avcodec_find_encoder_by_name(codecName);
+
+    memset(proxy, 0, sizeof(*proxy));
+
+    if (!encoder) {
+        fprintf(stderr, "Encoder %s not found\n", codecName);
+        return -1;
+    }
+
+    if (avformat_alloc_output_context2(&proxy->output_ctx, NULL, "matroska", filename) < 0) {
+        fprintf(stderr, "Cannot create output context for '%s'\n", filename);
+        return -1;
+    }
+
+    if (!(proxy->encoder_ctx = avcodec_alloc_context3(encoder)))
+        return AVERROR(ENOMEM);
+
+    proxy->encoder_ctx->width = width;
+    proxy->encoder_ctx->height = height;
+    proxy->encoder_ctx->pix_fmt = proxyPixelFormat(codecName);
+    proxy->encoder_ctx->time_base = time_base;
+    proxy->encoder_ctx->framerate = frame_rate;
+    proxy->encoder_ctx->gop_size = 1; // intra only, each frame is a keyframe
+    proxy->encoder_ctx->max_b_frames = 0;
+    proxy->encoder_ctx->thread_count = 0; // 0 = automatic
+    proxy->encoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if (strcmp(codecName, "mjpeg") == 0) {
+        proxy->encoder_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        proxy->encoder_ctx->global_quality = FF_QP2LAMBDA * 4;
+    }
+
+    if (proxy->output_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        proxy->encoder_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if ((ret = avcodec_open2(proxy->encoder_ctx, encoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open encoder %s\n", codecName);
+        return ret;
+    }
+
+    proxy->stream = avformat_new_stream(proxy->output_ctx, NULL);
+    if (!proxy->stream)
+        return AVERROR(ENOMEM);
+
+    if ((ret = avcodec_parameters_from_context(proxy->stream->codecpar, proxy->encoder_ctx)) < 0)
+        return ret;
+    proxy->stream->time_base = time_base;
+
+    if ((ret = avio_open(&proxy->output_ctx->pb, filename, AVIO_FLAG_WRITE)) < 0) {
+        fprintf(stderr, "Cannot open output file '%s'\n", filename);
+        return ret;
+    }
+
+    if ((ret = avformat_write_header(proxy->output_ctx, NULL)) < 0) {
+        fprintf(stderr, "Cannot write proxy header\n");
+        return ret;
+    }
+
+    proxy->packet = av_packet_alloc();
+    return 0;
+}
+
+/* Encodes and muxes one frame, pass NULL to flush the encoder */
+static int encodeProxyFrame(ProxyEncoder* proxy, AVFrame* frame)
+{
+    int ret = avcodec_send_frame(proxy->encoder_ctx, frame);
+    if (ret < 0) {
+        fprintf(stderr, "Error during encoding\n");
+        return ret;
+    }
+
+    while (1) {
+        ret = avcodec_receive_packet(proxy->encoder_ctx, proxy->packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while encoding\n");
+            return ret;
+        }
+
+        av_packet_rescale_ts(proxy->packet, proxy->encoder_ctx->time_base, proxy->stream->time_base);
+        proxy->packet->stream_index = proxy->stream->index;
+
+        if ((ret = av_interleaved_write_frame(proxy->output_ctx, proxy->packet)) < 0) {
+            fprintf(stderr, "Error while writing proxy packet\n");
+            return ret;
+        }
+    }
+}
+
+static void closeProxyEncoder(ProxyEncoder* proxy)
+{
+    if (proxy->output_ctx && proxy->output_ctx->pb) {
+        av_write_trailer(proxy->output_ctx);
+        avio_closep(&proxy->output_ctx->pb);
+    }
+    av_packet_free(&proxy->packet);
+    avcodec_free_context(&proxy->encoder_ctx);
+    avformat_free_context(proxy->output_ctx);
+    proxy->output_ctx = NULL;
+}
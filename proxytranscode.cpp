@@ -0,0 +1,231 @@
+/**
+ * @file
+ * Intra-only proxy transcode.
+ *
+ * Decodes the input like swdecode, scales it down with sws_scale and writes an all-intra
+ * low resolution proxy (mjpeg or ffv1 in mkv) with the same timestamps as the source.
+ * Encoding runs on its own thread, parallel to decoding, frames are handed over with a bounded queue.
+ * Seeking in the proxy only needs to decode a single frame, compare with seekbench.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include "framequeue.h"
+
+extern "C" {
+#include "proxyencoder.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+}
+
+int imageNumber = 0;
+
+int proxyWidth = 640;
+int proxyHeight;
+
+FrameQueue frameQueue(8);
+std::atomic<int> encoderError(0); // first encoder or muxer error
+
+static void encoder_thread(ProxyEncoder* proxy)
+{
+    AVFrame* frame;
+    int ret = 0;
+
+    while (ret >= 0 && (frame = frameQueue.pop()) != NULL) {
+        ret = encodeProxyFrame(proxy, frame);
+        av_frame_free(&frame);
+    }
+    if (ret >= 0)
+        ret = encodeProxyFrame(proxy, NULL);
+
+    if (ret < 0) {
+        encoderError = ret;
+        // the decoder stops at its next push, queued frames are freed
+        frameQueue.close();
+    }
+}
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsContext* sws_ctx, AVPixelFormat proxyFormat)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        AVFrame* proxyFrame = av_frame_alloc();
+        proxyFrame->width = proxyWidth;
+        proxyFrame->height = proxyHeight;
+        proxyFrame->format = proxyFormat;
+        if (av_frame_get_buffer(proxyFrame, 0) < 0) {
+            fprintf(stderr, "Can not alloc proxy frame\n");
+            av_frame_free(&proxyFrame);
+            av_frame_free(&frame);
+            return AVERROR(ENOMEM);
+        }
+
+        sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+                frame->linesize, 0, frame->height,
+                proxyFrame->data, proxyFrame->linesize);
+        proxyFrame->pts = frame->best_effort_timestamp;
+
+        frameQueue.push(proxyFrame);
+
+        imageNumber += 1;
+        av_frame_free(&frame);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    ProxyEncoder proxy;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input file> <output.mkv> [mjpeg|ffv1] [proxy width]\n", argv[0]);
+        return -1;
+    }
+    const char* codecName = argc >= 4 ? argv[3] : "mjpeg";
+    if (argc >= 5)
+        proxyWidth = atoi(argv[4]);
+
+    /* open the input file */
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    /* find the video stream information */
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    // keep aspect ratio, 4:2:0 needs even dimensions
+    proxyWidth &= ~1;
+    proxyHeight = (int)((long long)proxyWidth * decoder_ctx->height / decoder_ctx->width) & ~1;
+
+    if (openProxyEncoder(&proxy, argv[2], codecName, proxyWidth, proxyHeight,
+                         video->time_base, video->avg_frame_rate) < 0) {
+        return -1;
+    }
+    AVPixelFormat proxyFormat = proxyPixelFormat(codecName);
+
+    struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
+                                decoder_ctx->height,
+                                decoder_ctx->pix_fmt,
+                                proxyWidth,
+                                proxyHeight,
+                                proxyFormat,
+                                SWS_BILINEAR,
+                                NULL,
+                                NULL,
+                                NULL
+                            );
+
+    printf("Decoder name: %s, proxy %s %dx%d\n", decoder->name, codecName, proxyWidth, proxyHeight);
+
+    std::thread encoder(encoder_thread, &proxy);
+
+   long long start = time(NULL);
+   long frames = 0;
+
+    /* actual decoding, scaled frames are handed to the encoder thread */
+    while (ret >= 0 && encoderError == 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index)
+            ret = decode_write(decoder_ctx, &packet, sws_ctx, proxyFormat);
+
+        av_packet_unref(&packet);
+        frames += 1;
+        if (frames % 30 == 0)  {
+            long long end = time(NULL);
+            int took = (end - start);
+            fprintf(stdout, "FPS %f (encoder queue %zu)\n", frames / (double)took, frameQueue.size());
+        }
+    }
+
+    /* flush the decoder */
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_write(decoder_ctx, &packet, sws_ctx, proxyFormat);
+    av_packet_unref(&packet);
+
+    frameQueue.close();
+    encoder.join();
+    closeProxyEncoder(&proxy);
+
+    if (encoderError < 0) {
+        // do not leave a truncated proxy behind
+        fprintf(stderr, "Writing the proxy failed, removing '%s'\n", argv[2]);
+        unlink(argv[2]);
+        sws_freeContext(sws_ctx);
+        avcodec_free_context(&decoder_ctx);
+        avformat_close_input(&input_ctx);
+        return -1;
+    }
+
+   long long end = time(NULL);
+   int took = (end - start);
+   fprintf(stdout, "Took %d\n", took);
+   fprintf(stdout, "FPS %f\n", frames / (double)took);
+   fprintf(stdout, "Proxy frames %d\n", imageNumber);
+
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+
+    return 0;
+}
@@ -0,0 +1,303 @@
+/**
+ * @file
+ * Real-time paced preview.
+ *
+ * Output is paced to the media clock instead of running as fast as possible.
+ * Latency is bounded by:
+ *  - slice threading only, so the decoder holds no queue of frames beyond what reordering needs
+ *  - dropping frames that are already late before they are converted
+ *  - skipping decoding of non-reference frames while playback is behind
+ *  - a presentation queue of at most two converted frames
+ * Glass-to-glass latency (packet read -> frame presented) percentiles and drop counts are reported.
+ * With --headless the presented frames are not drawn, their timestamps are written to a file instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "framequeue.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+FrameQueue presentQueue(2);
+
+int64_t clockStart = AV_NOPTS_VALUE; // wall clock of the first frame
+int64_t firstPts = AV_NOPTS_VALUE;
+int64_t frameDuration = 33333; // in microseconds
+AVRational timeBase;
+
+std::map<int64_t, int64_t> packetArrival; // pts -> wall clock when the packet was read
+
+long droppedLate = 0;
+long droppedAtPresent = 0;
+long skipPeriods = 0;
+bool skipping = false;
+
+FILE* headlessOutput = NULL;
+
+/* Wall clock time in microseconds when the frame with this pts is due */
+static int64_t due_time(int64_t pts)
+{
+    return clockStart + av_rescale_q(pts - firstPts, timeBase, AV_TIME_BASE_Q);
+}
+
+static void display_frame(const AVFrame* frame)
+{
+    int x, y;
+    uint8_t *p0, *p;
+
+    p0 = frame->data[0];
+    puts("\033c");
+    for (y = 0; y < frame->height; y += 10) {
+        p = p0;
+        for (x = 0; x < frame->width; x += 5)
+            putchar(" .-+#"[p[x * 3 + 1] / 52]);
+        putchar('\n');
+        p0 += frame->linesize[0] * 10;
+    }
+    fflush(stdout);
+}
+
+static void present_thread(std::vector<int64_t>* latencies)
+{
+    AVFrame* frame;
+    long presented = 0;
+
+    while ((frame = presentQueue.pop()) != NULL) {
+        int64_t due = due_time(frame->pts);
+        int64_t now = av_gettime_relative();
+
+        if (now > due + frameDuration) {
+            droppedAtPresent += 1;
+        } else {
+            if (due > now)
+                av_usleep(due - now);
+
+            now = av_gettime_relative();
+            int64_t arrival = (int64_t)(intptr_t)frame->opaque;
+            latencies->push_back(now - arrival);
+
+            if (headlessOutput) {
+                fprintf(headlessOutput, "%ld %lld %lld %lld %lld\n", presented, (long long)frame->pts,
+                        (long long)(due - clockStart), (long long)(now - clockStart), (long long)(now - arrival));
+            } else {
+                display_frame(frame);
+            }
+            presented += 1;
+        }
+
+        av_frame_free(&frame);
+    }
+}
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsContext* sws_ctx)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        // the packet pts when there is one, so pacing and the arrival lookup use the same timestamp
+        int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+        int64_t now = av_gettime_relative();
+
+        if (clockStart == AV_NOPTS_VALUE) {
+            clockStart = now;
+            firstPts = pts;
+        }
+
+        int64_t arrival = now;
+        std::map<int64_t, int64_t>::iterator it = packetArrival.find(pts);
+        if (it != packetArrival.end()) {
+            arrival = it->second;
+            packetArrival.erase(packetArrival.begin(), ++it);
+        }
+
+        int64_t lateness = now - due_time(pts);
+
+        // far behind: stop decoding frames nobody references until we caught up
+        if (!skipping && lateness > 2 * frameDuration) {
+            avctx->skip_frame = AVDISCARD_NONREF;
+            skipping = true;
+            skipPeriods += 1;
+        } else if (skipping && lateness < 0) {
+            avctx->skip_frame = AVDISCARD_DEFAULT;
+            skipping = false;
+        }
+
+        // late frames are dropped before spending time on the conversion
+        if (lateness > frameDuration) {
+            droppedLate += 1;
+            av_frame_free(&frame);
+            continue;
+        }
+
+        AVFrame* pFrameRGB = av_frame_alloc();
+        pFrameRGB->width = 400;
+        pFrameRGB->height = 300;
+        pFrameRGB->format = FORMAT;
+        if (av_frame_get_buffer(pFrameRGB, 0) < 0) {
+            fprintf(stderr, "Can not alloc frame\n");
+            av_frame_free(&pFrameRGB);
+            av_frame_free(&frame);
+            return AVERROR(ENOMEM);
+        }
+        sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+                frame->linesize, 0, frame->height,
+                pFrameRGB->data, pFrameRGB->linesize);
+        pFrameRGB->pts = pts;
+        pFrameRGB->opaque = (void*)(intptr_t)arrival;
+
+        presentQueue.push(pFrameRGB);
+        av_frame_free(&frame);
+    }
+}
+
+static int64_t percentile(std::vector<int64_t>& sorted, double p)
+{
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    std::vector<int64_t> latencies;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [--headless <timestamps file>]\n", argv[0]);
+        return -1;
+    }
+    if (argc >= 4 && strcmp(argv[2], "--headless") == 0) {
+        if (!(headlessOutput = fopen(argv[3], "w"))) {
+            fprintf(stderr, "Cannot open '%s'\n", argv[3]);
+            return -1;
+        }
+        fprintf(headlessOutput, "# frame pts due_us presented_us latency_us\n");
+    }
+
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    timeBase = video->time_base;
+    if (video->avg_frame_rate.num > 0)
+        frameDuration = av_rescale_q(1, av_inv_q(video->avg_frame_rate), AV_TIME_BASE_Q);
+
+    // frame threading would queue thread_count frames inside the decoder
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = FF_THREAD_SLICE;
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
+                                decoder_ctx->height,
+                                decoder_ctx->pix_fmt,
+                                400,
+                                300,
+                                FORMAT,
+                                SWS_BILINEAR,
+                                NULL,
+                                NULL,
+                                NULL
+                            );
+
+    std::thread presenter(present_thread, &latencies);
+
+    while (ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index) {
+            if (packet.pts != AV_NOPTS_VALUE)
+                packetArrival[packet.pts] = av_gettime_relative();
+            ret = decode_write(decoder_ctx, &packet, sws_ctx);
+        }
+
+        av_packet_unref(&packet);
+    }
+
+    /* flush the decoder */
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_write(decoder_ctx, &packet, sws_ctx);
+    av_packet_unref(&packet);
+
+    presentQueue.close();
+    presenter.join();
+
+    fprintf(stderr, "Presented %zu, dropped late %ld, dropped at present %ld, non-ref skip periods %ld\n",
+            latencies.size(), droppedLate, droppedAtPresent, skipPeriods);
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        fprintf(stderr, "Glass-to-glass latency p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                percentile(latencies, 0.5) / 1000.0, percentile(latencies, 0.95) / 1000.0,
+                percentile(latencies, 0.99) / 1000.0, latencies.back() / 1000.0);
+    }
+
+    if (headlessOutput)
+        fclose(headlessOutput);
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+
+    return 0;
+}
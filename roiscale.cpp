@@ -0,0 +1,237 @@
+/**
+ * @file
+ * Region of interest scaling benchmark for zoomed previews.
+ *
+ * Decodes a sample of frames once, then shows a 400x300 view of each at zoom 1, 2, 4 and 8, panning the
+ * view across the frame from one frame to the next. Two paths are timed:
+ * the full path converts the whole frame to the zoomed size and crops the view out of it,
+ * the ROI path converts only the source rectangle of the view (RoiScaler).
+ * Prints the time per view of both, the area of interest and the difference between the two outputs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "roiscaler.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+#define TIMING_PASSES 3
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+char buf[200];
+
+std::vector<AVFrame*> frames;
+
+static int decode_frames(const char* filename, int count, int step)
+{
+    AVFormatContext *input_ctx = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    int video_stream, ret;
+    long decoded = 0;
+
+    if (avformat_open_input(&input_ctx, filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", filename);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+    if (avcodec_parameters_to_context(decoder_ctx, input_ctx->streams[video_stream]->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if (avcodec_open2(decoder_ctx, decoder, NULL) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    bool draining = false;
+    while ((int)frames.size() < count) {
+        if (!draining) {
+            if (av_read_frame(input_ctx, &packet) < 0) {
+                avcodec_send_packet(decoder_ctx, NULL);
+                draining = true;
+            } else {
+                if (packet.stream_index == video_stream)
+                    avcodec_send_packet(decoder_ctx, &packet);
+                av_packet_unref(&packet);
+            }
+        }
+
+        while ((int)frames.size() < count && (ret = avcodec_receive_frame(decoder_ctx, frame)) >= 0) {
+            if (decoded++ % step == 0)
+                frames.push_back(av_frame_clone(frame));
+            av_frame_unref(frame);
+        }
+        if (draining && ret == AVERROR_EOF)
+            break;
+    }
+
+    av_frame_free(&frame);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    return frames.empty() ? -1 : 0;
+}
+
+/* Source rectangle of the view of frame i, panning from the top left to the bottom right corner */
+static void view_rect(const AVFrame* frame, int zoom, size_t i, int* x, int* y, int* w, int* h)
+{
+    *w = frame->width / zoom;
+    *h = frame->height / zoom;
+    double position = frames.size() > 1 ? (double)i / (frames.size() - 1) : 0.5;
+    *x = (int)((frame->width - *w) * position) & ~1;
+    *y = (int)((frame->height - *h) * position) & ~1;
+}
+
+/* Whole frame to width * zoom x height * zoom, then crop the view */
+static int run_full(int zoom, AVFrame* out, int64_t* time)
+{
+    const AVFrame* first = frames[0];
+    int fullWidth = width * zoom;
+    int fullHeight = height * zoom;
+    struct SwsContext* sws_ctx = sws_getContext(first->width, first->height, (AVPixelFormat)first->format,
+                                                fullWidth, fullHeight, FORMAT, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!sws_ctx)
+        return -1;
+    AVFrame* full = allocateFrame(fullWidth, fullHeight, FORMAT);
+
+    *time = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        int x, y, w, h;
+        view_rect(frames[i], zoom, i, &x, &y, &w, &h);
+        int cropX = (int)((int64_t)x * fullWidth / frames[i]->width);
+        int cropY = (int)((int64_t)y * fullHeight / frames[i]->height);
+
+        int64_t start = av_gettime_relative();
+        sws_scale(sws_ctx, (uint8_t const * const *)frames[i]->data,
+                frames[i]->linesize, 0, frames[i]->height,
+                full->data, full->linesize);
+        av_image_copy_plane(out->data[0], out->linesize[0],
+                            full->data[0] + (size_t)cropY * full->linesize[0] + cropX * 3, full->linesize[0],
+                            width * 3, height);
+        *time += av_gettime_relative() - start;
+    }
+
+    av_freep(&full->opaque);
+    av_frame_free(&full);
+    sws_freeContext(sws_ctx);
+    return 0;
+}
+
+static int run_roi(RoiScaler* scaler, int zoom, AVFrame* out, int64_t* time)
+{
+    *time = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        int x, y, w, h;
+        view_rect(frames[i], zoom, i, &x, &y, &w, &h);
+
+        int64_t start = av_gettime_relative();
+        int ret = scaler->convert(frames[i], x, y, w, h, out->data, out->linesize, width, height, FORMAT);
+        *time += av_gettime_relative() - start;
+        if (ret < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Mean absolute difference of the two views of the last frame */
+static double view_difference(const AVFrame* a, const AVFrame* b)
+{
+    uint64_t sum = 0;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* rowA = a->data[0] + (size_t)y * a->linesize[0];
+        const uint8_t* rowB = b->data[0] + (size_t)y * b->linesize[0];
+        for (int x = 0; x < width * 3; ++x)
+            sum += abs(rowA[x] - rowB[x]);
+    }
+    return (double)sum / (width * height * 3);
+}
+
+int main(int argc, char *argv[])
+{
+    static const int zooms[] = { 1, 2, 4, 8 };
+    RoiScaler scaler;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [frames=30]\n", argv[0]);
+        return -1;
+    }
+    int count = argc >= 3 ? atoi(argv[2]) : 30;
+
+    if (decode_frames(argv[1], count, 10) < 0) {
+        fprintf(stderr, "No frames decoded\n");
+        return -1;
+    }
+    const AVFrame* first = frames[0];
+    fprintf(stdout, "%zu frames %dx%d %s -> %dx%d view\n", frames.size(), first->width, first->height,
+            av_get_pix_fmt_name((AVPixelFormat)first->format), width, height);
+
+    AVFrame* fullView = allocateFrame(width, height, FORMAT);
+    AVFrame* roiView = allocateFrame(width, height, FORMAT);
+
+    fprintf(stdout, "%5s %8s %14s %14s %8s %10s\n", "zoom", "area %", "full us/view", "ROI us/view", "speedup", "mean diff");
+    for (int zoom : zooms) {
+        int64_t fullBest = INT64_MAX, roiBest = INT64_MAX, time;
+        for (int pass = 0; pass < TIMING_PASSES; ++pass) {
+            if (run_full(zoom, fullView, &time) < 0) {
+                fprintf(stderr, "Cannot create the scaler for zoom %d\n", zoom);
+                return -1;
+            }
+            fullBest = std::min(fullBest, time);
+            if (run_roi(&scaler, zoom, roiView, &time) < 0) {
+                fprintf(stderr, "ROI conversion failed for zoom %d\n", zoom);
+                return -1;
+            }
+            roiBest = std::min(roiBest, time);
+        }
+
+        double fullUs = (double)fullBest / frames.size();
+        double roiUs = (double)roiBest / frames.size();
+        fprintf(stdout, "%5d %8.2f %14.1f %14.1f %7.1fx %10.2f\n", zoom, 100.0 / (zoom * zoom), fullUs, roiUs,
+                roiUs > 0 ? fullUs / roiUs : 0, view_difference(fullView, roiView));
+
+        snprintf(buf, sizeof(buf), "/tmp/%s_zoom%d.ppm", "roiscale", zoom);
+        ppm_save(roiView->data[0], roiView->linesize[0], width, height, buf);
+    }
+    fprintf(stdout, "SwsContext cache: %zu contexts, %ld hits, %ld misses\n", scaler.getCachedContexts(),
+            scaler.getHits(), scaler.getMisses());
+
+    av_freep(&fullView->opaque);
+    av_frame_free(&fullView);
+    av_freep(&roiView->opaque);
+    av_frame_free(&roiView);
+    for (AVFrame* frame : frames)
+        av_frame_free(&frame);
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Region of interest conversion for zoomed previews.
+ *
+ * Only the source rectangle is fed to sws_scale: the plane pointers are offset to its top left corner
+ * and the slice covers its rows only, so the cost follows the area of interest instead of the frame.
+ * The rectangle is clipped to the frame and widened to the chroma subsampling grid.
+ * SwsContexts are cached per geometry (rectangle size, formats, output size), not per position,
+ * so panning a zoomed view reuses the same context. The least recently used one is dropped when full.
+ */
+
+struct RoiGeometry
+{
+    int srcWidth;
+    int srcHeight;
+    int srcFormat;
+    int dstWidth;
+    int dstHeight;
+    int dstFormat;
+
+    bool operator<(const RoiGeometry& other) const
+    {
+        if (srcWidth != other.srcWidth) return srcWidth < other.srcWidth;
+        if (srcHeight != other.srcHeight) return srcHeight < other.srcHeight;
+        if (srcFormat != other.srcFormat) return srcFormat < other.srcFormat;
+        if (dstWidth != other.dstWidth) return dstWidth < other.dstWidth;
+        if (dstHeight != other.dstHeight) return dstHeight < other.dstHeight;
+        return dstFormat < other.dstFormat;
+    }
+};
+
+class RoiScaler
+{
+public:
+    RoiScaler(int flags = SWS_BILINEAR, size_t maxContexts = 8)
+        : flags(flags), maxContexts(maxContexts), useCounter(0), hits(0), misses(0)
+    {
+    }
+
+    ~RoiScaler()
+    {
+        for (auto& entry : contexts)
+            sws_freeContext(entry.second.sws_ctx);
+    }
+
+    /* Converts the rectangle (x, y, w, h) of a software frame to dst, returns 0 on success */
+    int convert(const AVFrame* frame, int x, int y, int w, int h,
+                uint8_t* const* dst, const int* dstLinesize, int dstWidth, int dstHeight, AVPixelFormat dstFormat)
+    {
+        AVPixelFormat format = (AVPixelFormat)frame->format;
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+        if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)))
+            return -1;
+
+        // clip, then align the corner down and the size up to the chroma grid
+        int right = FFMIN(x + w, frame->width);
+        int bottom = FFMIN(y + h, frame->height);
+        int alignX = (1 << desc->log2_chroma_w) - 1;
+        int alignY = (1 << desc->log2_chroma_h) - 1;
+        x = FFMAX(x, 0) & ~alignX;
+        y = FFMAX(y, 0) & ~alignY;
+        w = FFMIN((right - x + alignX) & ~alignX, frame->width - x);
+        h = FFMIN((bottom - y + alignY) & ~alignY, frame->height - y);
+        if (w <= 0 || h <= 0)
+            return -1;
+
+        RoiGeometry geometry = { w, h, format, dstWidth, dstHeight, dstFormat };
+        struct SwsContext* sws_ctx = getContext(geometry);
+        if (!sws_ctx)
+            return -1;
+
+        // same offsets as av_frame_apply_cropping, without a frame reference per call
+        const uint8_t* src[4] = { NULL };
+        int planes = av_pix_fmt_count_planes(format);
+        for (int i = 0; i < planes; ++i) {
+            int shiftX = (i == 1 || i == 2) ? desc->log2_chroma_w : 0;
+            int shiftY = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+            if ((desc->flags & AV_PIX_FMT_FLAG_PAL) && i == 1) {
+                src[i] = frame->data[i];
+                continue;
+            }
+            int step = 0;
+            for (int c = 0; c < desc->nb_components; ++c) {
+                if (desc->comp[c].plane == i) {
+                    step = desc->comp[c].step;
+                    break;
+                }
+            }
+            src[i] = frame->data[i] + (ptrdiff_t)(y >> shiftY) * frame->linesize[i] + (x >> shiftX) * step;
+        }
+
+        sws_scale(sws_ctx, src, frame->linesize, 0, h, dst, dstLinesize);
+        return 0;
+    }
+
+    size_t getCachedContexts() const
+    {
+        return contexts.size();
+    }
+
+    long getHits() const
+    {
+        return hits;
+    }
+
+    long getMisses() const
+    {
+        return misses;
+    }
+
+private:
+    struct CachedContext
+    {
+        struct SwsContext* sws_ctx;
+        uint64_t lastUse;
+    };
+
+    struct SwsContext* getContext(const RoiGeometry& geometry)
+    {
+        auto found = contexts.find(geometry);
+        if (found != contexts.end()) {
+            hits += 1;
+            found->second.lastUse = ++useCounter;
+            return found->second.sws_ctx;
+        }
+
+        misses += 1;
+        struct SwsContext* sws_ctx = sws_getContext(geometry.srcWidth, geometry.srcHeight, (AVPixelFormat)geometry.srcFormat,
+                                                    geometry.dstWidth, geometry.dstHeight, (AVPixelFormat)geometry.dstFormat,
+                                                    flags, NULL, NULL, NULL);
+        if (!sws_ctx)
+            return NULL;
+
+        if (contexts.size() >= maxContexts) {
+            auto oldest = contexts.begin();
+            for (auto it = contexts.begin(); it != contexts.end(); ++it) {
+                if (it->second.lastUse < oldest->second.lastUse)
+                    oldest = it;
+            }
+            sws_freeContext(oldest->second.sws_ctx);
+            contexts.erase(oldest);
+        }
+
+        CachedContext entry = { sws_ctx, ++useCounter };
+        contexts[geometry] = entry;
+        return sws_ctx;
+    }
+
+    int flags;
+    size_t maxContexts;
+    uint64_t useCounter;
+    long hits;
+    long misses;
+    std::map<RoiGeometry, CachedContext> contexts;
+};
@@ -0,0 +1,480 @@
+/**
+ * @file
+ * Scaler speed / quality report.
+ *
+ * Decodes a sample of frames from the clip once, then runs every candidate conversion to the output
+ * size in rgb24 over them: all sws algorithms, the libavfilter scale filter and a custom box filter
+ * kernel. Each result is compared with a high quality reference (SWS_LANCZOS with accurate rounding
+ * and full chroma interpolation) by PSNR over RGB and SSIM over luma (8x8 windows, stride 4).
+ * The conversions are timed over several passes, the fastest pass counts.
+ * Prints a table with the Pareto frontier (nothing else is both faster and at least as good in SSIM) marked,
+ * and writes all results to a CSV.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersrc.h>
+#include <libavfilter/buffersink.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+#define TIMING_PASSES 3
+
+enum CandidateKind { KIND_SWS, KIND_FILTER, KIND_CUSTOM };
+
+struct Candidate
+{
+    std::string name;
+    CandidateKind kind;
+    int swsFlags;
+    const char* filterFlags;
+    bool valid;
+    double usPerFrame;
+    double psnr;
+    double ssim;
+    bool pareto;
+};
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+typedef std::vector<uint8_t> Image; // packed rgb24, width * 3 bytes per line
+
+std::vector<AVFrame*> frames;
+AVRational timeBase;
+
+static int decode_frames(const char* filename, int count, int step)
+{
+    AVFormatContext *input_ctx = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    int video_stream, ret;
+    long decoded = 0;
+
+    if (avformat_open_input(&input_ctx, filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", filename);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+    timeBase = input_ctx->streams[video_stream]->time_base;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+    if (avcodec_parameters_to_context(decoder_ctx, input_ctx->streams[video_stream]->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if (avcodec_open2(decoder_ctx, decoder, NULL) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    bool draining = false;
+    while ((int)frames.size() < count) {
+        if (!draining) {
+            if (av_read_frame(input_ctx, &packet) < 0) {
+                avcodec_send_packet(decoder_ctx, NULL);
+                draining = true;
+            } else {
+                if (packet.stream_index == video_stream)
+                    avcodec_send_packet(decoder_ctx, &packet);
+                av_packet_unref(&packet);
+            }
+        }
+
+        while ((int)frames.size() < count && (ret = avcodec_receive_frame(decoder_ctx, frame)) >= 0) {
+            // sampled across the clip, not only its first scene
+            if (decoded++ % step == 0)
+                frames.push_back(av_frame_clone(frame));
+            av_frame_unref(frame);
+        }
+        if (draining && ret == AVERROR_EOF)
+            break;
+    }
+
+    av_frame_free(&frame);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    return frames.empty() ? -1 : 0;
+}
+
+static void copy_output(const AVFrame* out, Image* image)
+{
+    image->resize(width * height * 3);
+    av_image_copy_to_buffer(image->data(), image->size(), (const uint8_t * const *)out->data, out->linesize,
+                            FORMAT, width, height, 1);
+}
+
+static int run_sws(int flags, std::vector<Image>* outputs, int64_t* time)
+{
+    const AVFrame* first = frames[0];
+    struct SwsContext* sws_ctx = sws_getContext(first->width, first->height, (AVPixelFormat)first->format,
+                                                width, height, FORMAT, flags, NULL, NULL, NULL);
+    if (!sws_ctx)
+        return -1;
+
+    outputs->resize(frames.size());
+    *time = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        Image& image = (*outputs)[i];
+        uint8_t* dst[4] = { NULL };
+        int dstLinesize[4] = { 0 };
+
+        image.resize(width * height * 3);
+        av_image_fill_arrays(dst, dstLinesize, image.data(), FORMAT, width, height, 1);
+
+        int64_t start = av_gettime_relative();
+        sws_scale(sws_ctx, (uint8_t const * const *)frames[i]->data,
+                frames[i]->linesize, 0, frames[i]->height,
+                dst, dstLinesize);
+        *time += av_gettime_relative() - start;
+    }
+
+    sws_freeContext(sws_ctx);
+    return 0;
+}
+
+static int run_filter(const char* flags, std::vector<Image>* outputs, int64_t* time)
+{
+    const AVFrame* first = frames[0];
+    AVFilterGraph* filter_graph = avfilter_graph_alloc();
+    AVFilterContext *buffersrc_ctx = NULL, *buffersink_ctx = NULL;
+    AVFilterInOut* outputsIo = avfilter_inout_alloc();
+    AVFilterInOut* inputsIo = avfilter_inout_alloc();
+    char args[512];
+    char descr[256];
+    int ret;
+
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=1/1",
+             first->width, first->height, first->format, timeBase.num, timeBase.den);
+    snprintf(descr, sizeof(descr), "scale=%d:%d:flags=%s,format=rgb24", width, height, flags);
+
+    ret = avfilter_graph_create_filter(&buffersrc_ctx, avfilter_get_by_name("buffer"), "in", args, NULL, filter_graph);
+    if (ret >= 0)
+        ret = avfilter_graph_create_filter(&buffersink_ctx, avfilter_get_by_name("buffersink"), "out", NULL, NULL, filter_graph);
+    if (ret >= 0) {
+        outputsIo->name = av_strdup("in");
+        outputsIo->filter_ctx = buffersrc_ctx;
+        outputsIo->pad_idx = 0;
+        outputsIo->next = NULL;
+        inputsIo->name = av_strdup("out");
+        inputsIo->filter_ctx = buffersink_ctx;
+        inputsIo->pad_idx = 0;
+        inputsIo->next = NULL;
+        ret = avfilter_graph_parse_ptr(filter_graph, descr, &inputsIo, &outputsIo, NULL);
+    }
+    if (ret >= 0)
+        ret = avfilter_graph_config(filter_graph, NULL);
+    avfilter_inout_free(&inputsIo);
+    avfilter_inout_free(&outputsIo);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot create filter graph '%s'\n", descr);
+        avfilter_graph_free(&filter_graph);
+        return -1;
+    }
+
+    AVFrame* out = av_frame_alloc();
+    outputs->resize(frames.size());
+    *time = 0;
+    for (size_t i = 0; i < frames.size() && ret >= 0; ++i) {
+        int64_t start = av_gettime_relative();
+        ret = av_buffersrc_add_frame_flags(buffersrc_ctx, frames[i], AV_BUFFERSRC_FLAG_KEEP_REF);
+        if (ret >= 0)
+            ret = av_buffersink_get_frame(buffersink_ctx, out);
+        *time += av_gettime_relative() - start;
+
+        if (ret >= 0) {
+            copy_output(out, &(*outputs)[i]);
+            av_frame_unref(out);
+        }
+    }
+
+    av_frame_free(&out);
+    avfilter_graph_free(&filter_graph);
+    return ret < 0 ? -1 : 0;
+}
+
+/*
+ * Custom kernel: box filter (area average) straight from yuv420p to the output size,
+ * then BT.601 to rgb24 in fixed point. Only for 8 bit 4:2:0 input.
+ */
+static int run_box(std::vector<Image>* outputs, int64_t* time)
+{
+    const AVFrame* first = frames[0];
+    bool fullRange = first->format == AV_PIX_FMT_YUVJ420P || first->color_range == AVCOL_RANGE_JPEG;
+    if (first->format != AV_PIX_FMT_YUV420P && first->format != AV_PIX_FMT_YUVJ420P)
+        return -1;
+
+    int srcW = first->width, srcH = first->height;
+    std::vector<int> x0(width + 1), y0(height + 1);
+    for (int x = 0; x <= width; ++x)
+        x0[x] = (int64_t)x * srcW / width;
+    for (int y = 0; y <= height; ++y)
+        y0[y] = (int64_t)y * srcH / height;
+
+    outputs->resize(frames.size());
+    *time = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const AVFrame* frame = frames[i];
+        Image& image = (*outputs)[i];
+        image.resize(width * height * 3);
+
+        int64_t start = av_gettime_relative();
+        for (int y = 0; y < height; ++y) {
+            int ya = y0[y], yb = std::max(y0[y + 1], ya + 1);
+            int ca = ya / 2, cb = std::max((yb + 1) / 2, ca + 1);
+            uint8_t* dst = &image[y * width * 3];
+
+            for (int x = 0; x < width; ++x) {
+                int xa = x0[x], xb = std::max(x0[x + 1], xa + 1);
+                int cxa = xa / 2, cxb = std::max((xb + 1) / 2, cxa + 1);
+                int sumY = 0, sumU = 0, sumV = 0;
+
+                for (int sy = ya; sy < yb; ++sy) {
+                    const uint8_t* row = frame->data[0] + sy * frame->linesize[0];
+                    for (int sx = xa; sx < xb; ++sx)
+                        sumY += row[sx];
+                }
+                for (int sy = ca; sy < cb; ++sy) {
+                    const uint8_t* rowU = frame->data[1] + sy * frame->linesize[1];
+                    const uint8_t* rowV = frame->data[2] + sy * frame->linesize[2];
+                    for (int sx = cxa; sx < cxb; ++sx) {
+                        sumU += rowU[sx];
+                        sumV += rowV[sx];
+                    }
+                }
+
+                int chromaCount = (cb - ca) * (cxb - cxa);
+                int Y = sumY / ((yb - ya) * (xb - xa));
+                int U = sumU / chromaCount - 128;
+                int V = sumV / chromaCount - 128;
+
+                // BT.601, 16.16 fixed point
+                int r, g, b;
+                if (fullRange) {
+                    int c = Y << 16;
+                    r = c + 91881 * V;
+                    g = c - 22554 * U - 46802 * V;
+                    b = c + 116130 * U;
+                } else {
+                    int c = (Y - 16) * 76309;
+                    r = c + 104597 * V;
+                    g = c - 25675 * U - 53279 * V;
+                    b = c + 132201 * U;
+                }
+                dst[x * 3 + 0] = av_clip_uint8((r + 32768) >> 16);
+                dst[x * 3 + 1] = av_clip_uint8((g + 32768) >> 16);
+                dst[x * 3 + 2] = av_clip_uint8((b + 32768) >> 16);
+            }
+        }
+        *time += av_gettime_relative() - start;
+    }
+    return 0;
+}
+
+static double psnr(const std::vector<Image>& test, const std::vector<Image>& reference)
+{
+    double sum = 0;
+    double count = 0;
+
+    for (size_t i = 0; i < test.size(); ++i) {
+        for (size_t j = 0; j < test[i].size(); ++j) {
+            double d = (double)test[i][j] - reference[i][j];
+            sum += d * d;
+        }
+        count += test[i].size();
+    }
+    double mse = sum / count;
+    return mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+static void to_luma(const Image& image, std::vector<float>* luma)
+{
+    luma->resize(width * height);
+    for (int i = 0; i < width * height; ++i)
+        (*luma)[i] = 0.299f * image[i * 3] + 0.587f * image[i * 3 + 1] + 0.114f * image[i * 3 + 2];
+}
+
+static double ssim(const std::vector<Image>& test, const std::vector<Image>& reference)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    std::vector<float> a, b;
+    double sum = 0;
+    long windows = 0;
+
+    for (size_t i = 0; i < test.size(); ++i) {
+        to_luma(test[i], &a);
+        to_luma(reference[i], &b);
+
+        for (int y = 0; y + 8 <= height; y += 4) {
+            for (int x = 0; x + 8 <= width; x += 4) {
+                double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+                for (int wy = 0; wy < 8; ++wy) {
+                    for (int wx = 0; wx < 8; ++wx) {
+                        double va = a[(y + wy) * width + x + wx];
+                        double vb = b[(y + wy) * width + x + wx];
+                        sa += va;
+                        sb += vb;
+                        saa += va * va;
+                        sbb += vb * vb;
+                        sab += va * vb;
+                    }
+                }
+                double ma = sa / 64, mb = sb / 64;
+                double va = saa / 64 - ma * ma, vb = sbb / 64 - mb * mb, cov = sab / 64 - ma * mb;
+                sum += ((2 * ma * mb + c1) * (2 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+                windows += 1;
+            }
+        }
+    }
+    return windows ? sum / windows : 0;
+}
+
+static int run_candidate(const Candidate& candidate, std::vector<Image>* outputs, int64_t* time)
+{
+    switch (candidate.kind) {
+    case KIND_SWS:
+        return run_sws(candidate.swsFlags, outputs, time);
+    case KIND_FILTER:
+        return run_filter(candidate.filterFlags, outputs, time);
+    default:
+        return run_box(outputs, time);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<Candidate> candidates = {
+        { "sws fast_bilinear", KIND_SWS, SWS_FAST_BILINEAR },
+        { "sws bilinear",      KIND_SWS, SWS_BILINEAR },
+        { "sws bicubic",       KIND_SWS, SWS_BICUBIC },
+        { "sws experimental",  KIND_SWS, SWS_X },
+        { "sws point",         KIND_SWS, SWS_POINT },
+        { "sws area",          KIND_SWS, SWS_AREA },
+        { "sws bicublin",      KIND_SWS, SWS_BICUBLIN },
+        { "sws gauss",         KIND_SWS, SWS_GAUSS },
+        { "sws sinc",          KIND_SWS, SWS_SINC },
+        { "sws lanczos",       KIND_SWS, SWS_LANCZOS },
+        { "sws spline",        KIND_SWS, SWS_SPLINE },
+        { "sws bilinear accurate", KIND_SWS, SWS_BILINEAR | SWS_ACCURATE_RND },
+        { "filter fast_bilinear", KIND_FILTER, 0, "fast_bilinear" },
+        { "filter bilinear",   KIND_FILTER, 0, "bilinear" },
+        { "filter bicubic",    KIND_FILTER, 0, "bicubic" },
+        { "custom box yuv420p", KIND_CUSTOM },
+    };
+    std::vector<Image> reference, outputs;
+    int64_t time;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [frames=30] [csv file=/tmp/scalerreport.csv] [width height]\n", argv[0]);
+        return -1;
+    }
+    int count = argc >= 3 ? atoi(argv[2]) : 30;
+    const char* csvFile = argc >= 4 ? argv[3] : "/tmp/scalerreport.csv";
+    if (argc >= 6) {
+        width = atoi(argv[4]);
+        height = atoi(argv[5]);
+    }
+
+    if (decode_frames(argv[1], count, 10) < 0) {
+        fprintf(stderr, "No frames decoded\n");
+        return -1;
+    }
+    fprintf(stdout, "%zu frames %dx%d %s -> %dx%d rgb24\n", frames.size(), frames[0]->width, frames[0]->height,
+            av_get_pix_fmt_name((AVPixelFormat)frames[0]->format), width, height);
+
+    if (run_sws(SWS_LANCZOS | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT, &reference, &time) < 0) {
+        fprintf(stderr, "Cannot create the reference scaler\n");
+        return -1;
+    }
+
+    for (Candidate& candidate : candidates) {
+        int64_t best = INT64_MAX;
+        candidate.valid = true;
+        for (int pass = 0; pass < TIMING_PASSES && candidate.valid; ++pass) {
+            candidate.valid = run_candidate(candidate, &outputs, &time) == 0;
+            best = std::min(best, time);
+        }
+        if (!candidate.valid) {
+            fprintf(stdout, "%s: not available for this input\n", candidate.name.c_str());
+            continue;
+        }
+        candidate.usPerFrame = (double)best / frames.size();
+        candidate.psnr = psnr(outputs, reference);
+        candidate.ssim = ssim(outputs, reference);
+    }
+
+    // frontier: sorted by time, a candidate is on it if it beats the SSIM of everything faster
+    std::vector<Candidate*> sorted;
+    for (Candidate& candidate : candidates) {
+        candidate.pareto = false;
+        if (candidate.valid)
+            sorted.push_back(&candidate);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Candidate* a, const Candidate* b) {
+        return a->usPerFrame < b->usPerFrame;
+    });
+    double bestSsim = -1;
+    for (Candidate* candidate : sorted) {
+        if (candidate->ssim > bestSsim) {
+            candidate->pareto = true;
+            bestSsim = candidate->ssim;
+        }
+    }
+
+    FILE* csv = fopen(csvFile, "w");
+    if (csv)
+        fprintf(csv, "name,kind,us_per_frame,psnr_db,ssim,pareto\n");
+
+    fprintf(stdout, "   %-24s %10s %9s %8s\n", "path", "us/frame", "PSNR dB", "SSIM");
+    for (Candidate* candidate : sorted) {
+        fprintf(stdout, "%c  %-24s %10.1f %9.2f %8.5f\n", candidate->pareto ? '*' : ' ', candidate->name.c_str(),
+                candidate->usPerFrame, candidate->psnr, candidate->ssim);
+        if (csv) {
+            fprintf(csv, "%s,%s,%.1f,%.3f,%.6f,%d\n", candidate->name.c_str(),
+                    candidate->kind == KIND_SWS ? "sws" : candidate->kind == KIND_FILTER ? "filter" : "custom",
+                    candidate->usPerFrame, candidate->psnr, candidate->ssim, candidate->pareto);
+        }
+    }
+    fprintf(stdout, "* = Pareto frontier (faster than every path with a better SSIM)\n");
+
+    if (csv) {
+        fclose(csv);
+        fprintf(stdout, "Written %s\n", csvFile);
+    } else {
+        fprintf(stderr, "Cannot open '%s'\n", csvFile);
+    }
+
+    for (AVFrame* frame : frames)
+        av_frame_free(&frame);
+
+    return 0;
+}
@@ -0,0 +1,262 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Content aware thumbnail selection.
+ *
+ * Every decoded frame is reduced to a 64x36 luma proxy (2x2 samples per proxy pixel straight from the
+ * luma plane, sws only for formats without one), the features are computed on the proxy with SSE2 SAD:
+ * difference to the previous frame, luma histogram delta, sharpness (mean gradient) and mean luma.
+ * A scene ends on a cut (large difference and histogram change) or after the interval, the best scoring
+ * frame of the scene is kept as a reference and only that one is converted by the caller.
+ * Black, white, blurred and mid-transition frames score low.
+ */
+
+#define PROXY_WIDTH 64
+#define PROXY_HEIGHT 36
+#define PROXY_PIXELS (PROXY_WIDTH * PROXY_HEIGHT)
+#define PROXY_HISTOGRAM_BINS 16
+
+struct FrameFeatures
+{
+    double sad;            // mean absolute difference to the previous frame, per pixel
+    double histogramDelta; // 0 (same luma distribution) .. 1 (disjoint)
+    double sharpness;      // mean absolute horizontal + vertical gradient
+    double meanLuma;
+};
+
+enum SelectionMode
+{
+    SELECT_SCENES,    // one thumbnail per scene, long scenes are split at the interval
+    SELECT_INTERVALS, // one thumbnail per interval, cuts are ignored
+};
+
+struct SceneSelection
+{
+    AVFrame* frame; // reference to the decoded frame, owned by whoever took the selection
+    double time;
+    double sceneStart;
+    double score;
+    FrameFeatures features;
+};
+
+/* Sum of absolute differences, bytes must be a multiple of 16 */
+static uint64_t proxySad(const uint8_t* a, const uint8_t* b, int bytes)
+{
+#ifdef __SSE2__
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < bytes; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+    }
+    return (uint64_t)_mm_cvtsi128_si64(sum) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum));
+#else
+    uint64_t sum = 0;
+    for (int i = 0; i < bytes; ++i)
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return sum;
+#endif
+}
+
+static double proxySharpness(const uint8_t* proxy)
+{
+    uint64_t horizontal = 0;
+    for (int y = 0; y < PROXY_HEIGHT; ++y) {
+        const uint8_t* row = proxy + y * PROXY_WIDTH;
+        // every pixel against its right neighbour, the last 16 against their left one
+        horizontal += proxySad(row, row + 1, PROXY_WIDTH - 16);
+        horizontal += proxySad(row + PROXY_WIDTH - 16, row + PROXY_WIDTH - 17, 16);
+    }
+    uint64_t vertical = proxySad(proxy, proxy + PROXY_WIDTH, PROXY_PIXELS - PROXY_WIDTH);
+    return (double)(horizontal + vertical) / (2 * PROXY_PIXELS);
+}
+
+static double proxyMean(const uint8_t* proxy)
+{
+    static const uint8_t zero[PROXY_WIDTH] = { 0 };
+    uint64_t sum = 0;
+    for (int y = 0; y < PROXY_HEIGHT; ++y)
+        sum += proxySad(proxy + y * PROXY_WIDTH, zero, PROXY_WIDTH);
+    return (double)sum / PROXY_PIXELS;
+}
+
+static double thumbnailScore(const FrameFeatures& features)
+{
+    // black, white and faded frames, only picked when the scene has nothing else
+    double exposure = (features.meanLuma < 24 || features.meanLuma > 232) ? 0.05 : 1.0;
+    // frames in a transition or with fast motion differ a lot from the previous one
+    double stability = 1.0 / (1.0 + features.sad / 8.0);
+    return features.sharpness * exposure * stability;
+}
+
+class SceneSelector
+{
+public:
+    SceneSelector(SelectionMode mode, double interval, double minScene = 0.5, double cutSad = 24, double cutHistogram = 0.25)
+        : mode(mode), interval(interval), minScene(minScene), cutSad(cutSad), cutHistogram(cutHistogram),
+          current(0), havePrevious(false), sceneStart(0), fallback(NULL)
+    {
+        memset(&candidate, 0, sizeof(candidate));
+        memset(&features, 0, sizeof(features));
+    }
+
+    ~SceneSelector()
+    {
+        av_frame_free(&candidate.frame);
+        while (!ready.empty()) {
+            av_frame_free(&ready.front().frame);
+            ready.pop_front();
+        }
+        sws_freeContext(fallback);
+    }
+
+    /* Scores a decoded frame, returns true when a scene ended and its selection can be taken */
+    bool add(const AVFrame* frame, double time)
+    {
+        uint8_t* proxy = proxies[current];
+        if (makeProxy(frame, proxy) < 0)
+            return false;
+
+        int* histogram = histograms[current];
+        memset(histogram, 0, sizeof(histograms[current]));
+        for (int i = 0; i < PROXY_PIXELS; ++i)
+            histogram[proxy[i] >> 4] += 1;
+
+        features.sharpness = proxySharpness(proxy);
+        features.meanLuma = proxyMean(proxy);
+        features.sad = 0;
+        features.histogramDelta = 0;
+        if (havePrevious) {
+            const int* previous = histograms[current ^ 1];
+            int delta = 0;
+            for (int i = 0; i < PROXY_HISTOGRAM_BINS; ++i)
+                delta += abs(histogram[i] - previous[i]);
+            features.sad = (double)proxySad(proxy, proxies[current ^ 1], PROXY_PIXELS) / PROXY_PIXELS;
+            features.histogramDelta = delta / (2.0 * PROXY_PIXELS);
+        }
+        current ^= 1;
+        havePrevious = true;
+
+        if (candidate.frame) {
+            double length = time - sceneStart;
+            bool cut = mode == SELECT_SCENES && length >= minScene &&
+                       features.sad >= cutSad && features.histogramDelta >= cutHistogram;
+            if (cut || length >= interval)
+                endScene();
+        }
+        if (!candidate.frame)
+            sceneStart = time;
+
+        double score = thumbnailScore(features);
+        if (!candidate.frame || score > candidate.score) {
+            av_frame_free(&candidate.frame);
+            candidate.frame = av_frame_clone(frame);
+            candidate.time = time;
+            candidate.sceneStart = sceneStart;
+            candidate.score = score;
+            candidate.features = features;
+        }
+        return !ready.empty();
+    }
+
+    /* Ends the last scene at the end of the input, returns true when there is a selection to take */
+    bool finish()
+    {
+        if (candidate.frame)
+            endScene();
+        return !ready.empty();
+    }
+
+    bool hasSelection() const
+    {
+        return !ready.empty();
+    }
+
+    /* The caller owns the returned frame */
+    SceneSelection take()
+    {
+        SceneSelection selection = ready.front();
+        ready.pop_front();
+        return selection;
+    }
+
+    /* Features of the last frame added */
+    const FrameFeatures& lastFeatures() const
+    {
+        return features;
+    }
+
+private:
+    void endScene()
+    {
+        ready.push_back(candidate);
+        candidate.frame = NULL;
+    }
+
+    int makeProxy(const AVFrame* frame, uint8_t* proxy)
+    {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+        if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+            return -1;
+
+        // 8 bit luma in its own plane (yuv420p, nv12, ...), sampled directly
+        if (!(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) && desc->comp[0].plane == 0 &&
+            desc->comp[0].step == 1 && desc->comp[0].depth == 8 &&
+            frame->width >= 2 * PROXY_WIDTH && frame->height >= 2 * PROXY_HEIGHT) {
+            int xs[PROXY_WIDTH];
+            for (int x = 0; x < PROXY_WIDTH; ++x)
+                xs[x] = FFMIN((2 * x + 1) * frame->width / (2 * PROXY_WIDTH), frame->width - 2);
+
+            for (int y = 0; y < PROXY_HEIGHT; ++y) {
+                int sy = FFMIN((2 * y + 1) * frame->height / (2 * PROXY_HEIGHT), frame->height - 2);
+                const uint8_t* row0 = frame->data[0] + (size_t)sy * frame->linesize[0];
+                const uint8_t* row1 = row0 + frame->linesize[0];
+                uint8_t* out = proxy + y * PROXY_WIDTH;
+                for (int x = 0; x < PROXY_WIDTH; ++x) {
+                    int sx = xs[x];
+                    out[x] = (row0[sx] + row0[sx + 1] + row1[sx] + row1[sx + 1] + 2) >> 2;
+                }
+            }
+            return 0;
+        }
+
+        fallback = sws_getCachedContext(fallback, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                        PROXY_WIDTH, PROXY_HEIGHT, AV_PIX_FMT_GRAY8, SWS_AREA, NULL, NULL, NULL);
+        if (!fallback)
+            return -1;
+        uint8_t* dst[4] = { proxy, NULL, NULL, NULL };
+        int dstLinesize[4] = { PROXY_WIDTH, 0, 0, 0 };
+        sws_scale(fallback, (uint8_t const * const *)frame->data, frame->linesize, 0, frame->height, dst, dstLinesize);
+        return 0;
+    }
+
+    SelectionMode mode;
+    double interval;
+    double minScene;
+    double cutSad;
+    double cutHistogram;
+
+    alignas(16) uint8_t proxies[2][PROXY_PIXELS];
+    int histograms[2][PROXY_HISTOGRAM_BINS];
+    int current;
+    bool havePrevious;
+    FrameFeatures features;
+
+    double sceneStart;
+    SceneSelection candidate;
+    std::deque<SceneSelection> ready;
+    struct SwsContext* fallback;
+};
@@ -0,0 +1,225 @@
+/**
+ * @file
+ * Exposure scopes computed during colour conversion.
+ *
+ * Converts frames to rgb24 three ways: conversion only, conversion with the scope statistics fused into it
+ * (ScopeScaler, band by band while the rows are in cache) and conversion followed by a separate scan of the
+ * finished frame. While decoding every frame is checked to give the same statistics both ways and the luma
+ * range is printed every 100 frames, only the first TIMING_FRAMES frames are kept. The timing passes cycle
+ * through those until as many frames as were decoded are converted, so memory stays bounded at any resolution.
+ * Prints the time per frame of each way and saves the waveform summary of the last frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "scopestats.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+#define TIMING_PASSES 3
+#define TIMING_FRAMES 16
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+char buf[200];
+
+std::vector<AVFrame*> frames; // the first TIMING_FRAMES frames
+
+/* Calls onFrame for every decoded frame (at most count), stops when it returns < 0 */
+template <typename OnFrame>
+static int decode_frames(const char* filename, int count, OnFrame&& onFrame)
+{
+    AVFormatContext *input_ctx = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    int video_stream, ret;
+    int decoded = 0;
+
+    if (avformat_open_input(&input_ctx, filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", filename);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+    if (avcodec_parameters_to_context(decoder_ctx, input_ctx->streams[video_stream]->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if (avcodec_open2(decoder_ctx, decoder, NULL) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    bool draining = false;
+    bool failed = false;
+    while (decoded < count && !failed) {
+        if (!draining) {
+            if (av_read_frame(input_ctx, &packet) < 0) {
+                avcodec_send_packet(decoder_ctx, NULL);
+                draining = true;
+            } else {
+                if (packet.stream_index == video_stream)
+                    avcodec_send_packet(decoder_ctx, &packet);
+                av_packet_unref(&packet);
+            }
+        }
+
+        while (!failed && decoded < count && (ret = avcodec_receive_frame(decoder_ctx, frame)) >= 0) {
+            decoded += 1;
+            if ((int)frames.size() < TIMING_FRAMES)
+                frames.push_back(av_frame_clone(frame));
+            failed = onFrame(frame) < 0;
+            av_frame_unref(frame);
+        }
+        if (draining && ret == AVERROR_EOF)
+            break;
+    }
+
+    av_frame_free(&frame);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    return failed || decoded == 0 ? -1 : decoded;
+}
+
+static bool same_stats(const ScopeStats& a, const ScopeStats& b)
+{
+    return memcmp(a.histogram, b.histogram, sizeof(a.histogram)) == 0 && a.columnMin == b.columnMin &&
+           a.columnMax == b.columnMax && a.columnMean == b.columnMean;
+}
+
+/* Column min..max as a grey bar and the column mean in white, luma 255 at the top */
+static void save_waveform(const ScopeStats& stats, const char* filename)
+{
+    int w = (int)stats.columnMin.size();
+    std::vector<uint8_t> image((size_t)w * 256 * 3, 0);
+    for (int x = 0; x < w; ++x) {
+        for (int v = stats.columnMin[x]; v <= stats.columnMax[x]; ++v)
+            memset(&image[((size_t)(255 - v) * w + x) * 3], 96, 3);
+        memset(&image[((size_t)(255 - stats.columnMean[x]) * w + x) * 3], 255, 3);
+    }
+    snprintf(buf, sizeof(buf), "%s", filename);
+    ppm_save(image.data(), w * 3, w, 256, buf);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char* pathNames[] = { "convert", "fused", "convert+scan" };
+    ScopeStats fused, scanned;
+    ScopeScaler* scaler = NULL;
+    AVFrame* out = NULL;
+    long checked = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [frames=300] [width height, default source size]\n", argv[0]);
+        return -1;
+    }
+    int count = argc >= 3 ? atoi(argv[2]) : 300;
+
+    // the statistics of both ways must match on every frame before timing them
+    int decoded = decode_frames(argv[1], count, [&](AVFrame* frame) {
+        if (!scaler) {
+            width = argc >= 5 ? atoi(argv[3]) : frame->width;
+            height = argc >= 5 ? atoi(argv[4]) : frame->height;
+            fprintf(stdout, "%dx%d %s -> %dx%d %s\n", frame->width, frame->height,
+                    av_get_pix_fmt_name((AVPixelFormat)frame->format), width, height, av_get_pix_fmt_name(FORMAT));
+
+            scaler = new ScopeScaler(frame->width, frame->height, (AVPixelFormat)frame->format, width, height);
+            if (!scaler->valid()) {
+                fprintf(stderr, "Cannot create the scaler\n");
+                return -1;
+            }
+
+            // refcounted, sws_frame_start would allocate a new buffer for every frame otherwise
+            out = av_frame_alloc();
+            out->width = width;
+            out->height = height;
+            out->format = FORMAT;
+            if (av_frame_get_buffer(out, 0) < 0) {
+                fprintf(stderr, "Can not alloc output frame\n");
+                return -1;
+            }
+        }
+
+        if (scaler->convert(frame, out, &fused) < 0) {
+            fprintf(stderr, "Conversion failed\n");
+            return -1;
+        }
+        scaler->scan(out, &scanned);
+        if (!same_stats(fused, scanned)) {
+            fprintf(stderr, "Fused and scanned statistics differ on frame %ld\n", checked);
+            return -1;
+        }
+        if (checked % 100 == 0)
+            fprintf(stdout, "frame %5ld luma min %3d max %3d mean %6.2f, rgb mean %6.2f %6.2f %6.2f\n", checked,
+                    fused.min[SCOPE_LUMA], fused.max[SCOPE_LUMA], fused.mean[SCOPE_LUMA],
+                    fused.mean[SCOPE_R], fused.mean[SCOPE_G], fused.mean[SCOPE_B]);
+        checked += 1;
+        return 0;
+    });
+    if (decoded < 0) {
+        fprintf(stderr, "No frames checked\n");
+        return -1;
+    }
+    fprintf(stdout, "%ld frames checked, timing %d passes of %d conversions over %zu kept frames\n", checked,
+            TIMING_PASSES, decoded, frames.size());
+    if (!scaler->isSliced())
+        fprintf(stdout, "This conversion can not be sliced, statistics are scanned after it\n");
+
+    int64_t best[3] = { INT64_MAX, INT64_MAX, INT64_MAX };
+    for (int pass = 0; pass < TIMING_PASSES; ++pass) {
+        for (int path = 0; path < 3; ++path) {
+            int64_t start = av_gettime_relative();
+            for (int i = 0; i < decoded; ++i) {
+                scaler->convert(frames[i % frames.size()], out, path == 1 ? &fused : NULL);
+                if (path == 2)
+                    scaler->scan(out, &scanned);
+            }
+            best[path] = std::min(best[path], av_gettime_relative() - start);
+        }
+    }
+
+    fprintf(stdout, "%-14s %12s %14s\n", "path", "us/frame", "scope us/frame");
+    for (int path = 0; path < 3; ++path) {
+        double us = (double)best[path] / decoded;
+        double convertUs = (double)best[0] / decoded;
+        fprintf(stdout, "%-14s %12.1f %14.1f\n", pathNames[path], us, us - convertUs);
+    }
+
+    save_waveform(fused, "/tmp/scopes_waveform.ppm");
+
+    av_frame_free(&out);
+    delete scaler;
+    for (AVFrame* frame : frames)
+        av_frame_free(&frame);
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Exposure scope statistics computed in the conversion pass.
+ *
+ * sws_scale is a black box, so instead of a second pass over the finished frame the conversion is driven
+ * in bands of output rows (sws_frame_start / sws_receive_slice) and every band is scanned right after it
+ * was written, while it is still in cache. The statistics are taken from the rgb24 output:
+ * 256 bin R, G, B and luma (BT.709) histograms, min/max/mean per channel (from the histograms) and a
+ * column-wise waveform summary (min/max/mean luma of every column, SSE2).
+ * Scalers sws cannot slice (cascaded contexts) convert the whole frame first, the scan is the same.
+ */
+
+enum ScopeChannel { SCOPE_R, SCOPE_G, SCOPE_B, SCOPE_LUMA, SCOPE_CHANNELS };
+
+struct ScopeStats
+{
+    uint32_t histogram[SCOPE_CHANNELS][256];
+    uint8_t min[SCOPE_CHANNELS];
+    uint8_t max[SCOPE_CHANNELS];
+    double mean[SCOPE_CHANNELS];
+
+    // waveform summary, one entry per output column
+    std::vector<uint8_t> columnMin;
+    std::vector<uint8_t> columnMax;
+    std::vector<uint8_t> columnMean;
+};
+
+class ScopeScaler
+{
+public:
+    ScopeScaler(int srcWidth, int srcHeight, AVPixelFormat srcFormat, int dstWidth, int dstHeight,
+                int flags = SWS_BILINEAR, int bandRows = 16)
+        : width(dstWidth), height(dstHeight), paddedWidth((dstWidth + 15) & ~15), sliced(true)
+    {
+        sws_ctx = sws_getContext(srcWidth, srcHeight, srcFormat, dstWidth, dstHeight, AV_PIX_FMT_RGB24,
+                                 flags, NULL, NULL, NULL);
+        int alignment = sws_ctx ? sws_receive_slice_alignment(sws_ctx) : 1;
+        band = (bandRows + alignment - 1) / alignment * alignment;
+
+        luma.resize(paddedWidth);
+        columnMin.resize(paddedWidth);
+        columnMax.resize(paddedWidth);
+        columnBandSum.resize(paddedWidth);
+        columnSum.resize(paddedWidth);
+    }
+
+    ~ScopeScaler()
+    {
+        sws_freeContext(sws_ctx);
+    }
+
+    bool valid() const
+    {
+        return sws_ctx != NULL;
+    }
+
+    /* False when sws could not produce bands, the statistics then came from a scan after the conversion */
+    bool isSliced() const
+    {
+        return sliced;
+    }
+
+    /*
+     * Converts src into dst (refcounted rgb24 frame of the output size) and fills stats in the same pass.
+     * With stats NULL it only converts, the same way.
+     */
+    int convert(const AVFrame* src, AVFrame* dst, ScopeStats* stats)
+    {
+        int ret;
+
+        if (stats)
+            begin();
+        if ((ret = sws_frame_start(sws_ctx, dst, src)) < 0 ||
+            (ret = sws_send_slice(sws_ctx, 0, src->height)) < 0) {
+            sws_frame_end(sws_ctx);
+            return ret;
+        }
+
+        for (int y = 0; y < height && sliced; y += band) {
+            int rows = FFMIN(band, height - y);
+            if ((ret = sws_receive_slice(sws_ctx, y, rows)) == AVERROR(EINVAL) && y == 0) {
+                sliced = false;
+                break;
+            }
+            if (ret < 0) {
+                sws_frame_end(sws_ctx);
+                return ret;
+            }
+            if (stats)
+                scanRows(dst, y, rows);
+        }
+        if (!sliced) {
+            if ((ret = sws_receive_slice(sws_ctx, 0, height)) < 0) {
+                sws_frame_end(sws_ctx);
+                return ret;
+            }
+            if (stats) {
+                for (int y = 0; y < height; y += band)
+                    scanRows(dst, y, FFMIN(band, height - y));
+            }
+        }
+        sws_frame_end(sws_ctx);
+
+        if (stats)
+            finish(stats);
+        return 0;
+    }
+
+    /* Separate pass over a finished rgb24 frame, what the scopes did before */
+    void scan(const AVFrame* dst, ScopeStats* stats)
+    {
+        begin();
+        for (int y = 0; y < height; y += band)
+            scanRows(dst, y, FFMIN(band, height - y));
+        finish(stats);
+    }
+
+private:
+    void begin()
+    {
+        memset(histograms, 0, sizeof(histograms));
+        memset(columnMin.data(), 255, paddedWidth);
+        memset(columnMax.data(), 0, paddedWidth);
+        memset(columnSum.data(), 0, paddedWidth * sizeof(uint32_t));
+    }
+
+    /* At most 257 rows, so the 16 bit column sums of a band can not overflow */
+    void scanRows(const AVFrame* frame, int y0, int rows)
+    {
+        memset(columnBandSum.data(), 0, paddedWidth * sizeof(uint16_t));
+
+        for (int y = y0; y < y0 + rows; ++y) {
+            const uint8_t* p = frame->data[0] + (size_t)y * frame->linesize[0];
+            uint8_t* l = luma.data();
+
+            // two copies of every histogram, so neighbouring pixels with the same value do not wait for each other
+            for (int x = 0; x < width; ++x, p += 3) {
+                int r = p[0], g = p[1], b = p[2];
+                int yv = (54 * r + 183 * g + 19 * b + 128) >> 8; // BT.709 weights in 1/256
+                uint32_t (*h)[256] = histograms[x & 1];
+                h[SCOPE_R][r] += 1;
+                h[SCOPE_G][g] += 1;
+                h[SCOPE_B][b] += 1;
+                h[SCOPE_LUMA][yv] += 1;
+                l[x] = yv;
+            }
+            scanColumns(l);
+        }
+
+        for (int x = 0; x < width; ++x)
+            columnSum[x] += columnBandSum[x];
+    }
+
+    void scanColumns(const uint8_t* l)
+    {
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        for (int x = 0; x < paddedWidth; x += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(l + x));
+            __m128i* minp = (__m128i*)(columnMin.data() + x);
+            __m128i* maxp = (__m128i*)(columnMax.data() + x);
+            _mm_storeu_si128(minp, _mm_min_epu8(_mm_loadu_si128(minp), v));
+            _mm_storeu_si128(maxp, _mm_max_epu8(_mm_loadu_si128(maxp), v));
+
+            __m128i* sum = (__m128i*)(columnBandSum.data() + x);
+            _mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum), _mm_unpacklo_epi8(v, zero)));
+            _mm_storeu_si128(sum + 1, _mm_add_epi16(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi8(v, zero)));
+        }
+#else
+        for (int x = 0; x < width; ++x) {
+            columnMin[x] = FFMIN(columnMin[x], l[x]);
+            columnMax[x] = FFMAX(columnMax[x], l[x]);
+            columnBandSum[x] += l[x];
+        }
+#endif
+    }
+
+    void finish(ScopeStats* stats)
+    {
+        for (int c = 0; c < SCOPE_CHANNELS; ++c) {
+            uint64_t count = 0, sum = 0;
+            int first = -1, last = 0;
+            for (int i = 0; i < 256; ++i) {
+                uint32_t n = histograms[0][c][i] + histograms[1][c][i];
+                stats->histogram[c][i] = n;
+                if (n) {
+                    if (first < 0)
+                        first = i;
+                    last = i;
+                }
+                count += n;
+                sum += (uint64_t)n * i;
+            }
+            stats->min[c] = first < 0 ? 0 : first;
+            stats->max[c] = last;
+            stats->mean[c] = count ? (double)sum / count : 0;
+        }
+
+        stats->columnMin.assign(columnMin.begin(), columnMin.begin() + width);
+        stats->columnMax.assign(columnMax.begin(), columnMax.begin() + width);
+        stats->columnMean.resize(width);
+        for (int x = 0; x < width; ++x)
+            stats->columnMean[x] = (columnSum[x] + height / 2) / height;
+    }
+
+    struct SwsContext* sws_ctx;
+    int width;
+    int height;
+    int paddedWidth; // column arrays are padded to whole SSE2 registers
+    int band;
+    bool sliced;
+
+    uint32_t histograms[2][SCOPE_CHANNELS][256];
+    std::vector<uint8_t> luma;
+    std::vector<uint8_t> columnMin;
+    std::vector<uint8_t> columnMax;
+    std::vector<uint16_t> columnBandSum;
+    std::vector<uint32_t> columnSum;
+};
@@ -0,0 +1,178 @@
+/**
+ * @file
+ * Scrub trace replay benchmark for the frame server.
+ *
+ * A trace is a list of requested positions in milliseconds, one per line (# starts a comment), as recorded
+ * from a timeline while playing, dragging the playhead and jumping. Instead of a file one of the built in
+ * traces can be used, it is written to /tmp/scrubbench_<name>.trace so it can be edited and replayed:
+ * play (frame by frame with pauses), scrub (playhead dragged back and forth at varying speed), jump (random).
+ * The trace is replayed with FrameServer and with a server that seeks for every request. Prints the latency
+ * percentiles of both, the routes taken and the frames decoded per request, and checks both served the same frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "frameserver.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+char buf[200];
+
+static const char* routeNames[ROUTE_COUNT] = { "current", "forward", "seek fwd", "seek back" };
+
+static double percentile(std::vector<double>& sorted, double p)
+{
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+static int read_trace(const char* filename, std::vector<int64_t>* trace)
+{
+    char line[256];
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open trace '%s'\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        long long ms;
+        if (line[0] != '#' && sscanf(line, "%lld", &ms) == 1)
+            trace->push_back(ms);
+    }
+    fclose(file);
+    return trace->empty() ? -1 : 0;
+}
+
+/* Built in traces, positions are clamped to the duration */
+static int make_trace(const char* name, int requests, int64_t durationMs, double frameMs, std::vector<int64_t>* trace)
+{
+    unsigned int seed = 1;
+    double position = 0;
+
+    if (strcmp(name, "play") == 0) {
+        // frame by frame, every 100 frames a pause repeats the same position
+        for (int i = 0; i < requests; ++i) {
+            trace->push_back((int64_t)position);
+            if (i % 100 >= 10)
+                position += frameMs;
+        }
+    } else if (strcmp(name, "scrub") == 0) {
+        // drag speed changes every 20 requests, between 8 frames back and 8 frames ahead per request
+        double step = frameMs;
+        for (int i = 0; i < requests; ++i) {
+            if (i % 20 == 0)
+                step = frameMs * (int)(rand_r(&seed) % 17 - 8);
+            position = std::max(0.0, std::min((double)durationMs, position + step));
+            trace->push_back((int64_t)position);
+        }
+    } else if (strcmp(name, "jump") == 0) {
+        for (int i = 0; i < requests; ++i)
+            trace->push_back(durationMs > 0 ? rand_r(&seed) % durationMs : 0);
+    } else {
+        return -1;
+    }
+
+    snprintf(buf, sizeof(buf), "/tmp/scrubbench_%s.trace", name);
+    FILE* file = fopen(buf, "w");
+    if (file) {
+        fprintf(file, "# %s trace, requested position in ms per line\n", name);
+        for (int64_t ms : *trace)
+            fprintf(file, "%lld\n", (long long)ms);
+        fclose(file);
+    }
+    return 0;
+}
+
+/* Replays the trace, returns the pts served per request (AV_NOPTS_VALUE when it failed) */
+static int replay(const char* filename, const std::vector<int64_t>& trace, double forwardLimit, const char* name,
+                  std::vector<int64_t>* served)
+{
+    FrameServer server;
+    std::vector<double> latencies;
+    const AVFrame* frame = NULL;
+
+    server.setForwardLimit(forwardLimit);
+    if (server.open(filename) < 0)
+        return -1;
+
+    for (int64_t ms : trace) {
+        int64_t start = av_gettime_relative();
+        frame = server.getFrame(server.timestampFromMs(ms), width, height, FORMAT);
+        latencies.push_back((av_gettime_relative() - start) / 1000.0);
+        served->push_back(frame ? frame->pts : AV_NOPTS_VALUE);
+    }
+
+    const FrameServerStats& stats = server.getStats();
+    std::sort(latencies.begin(), latencies.end());
+    fprintf(stdout, "%-12s %8.2f %8.2f %8.2f %8.2f %8.2f", name, percentile(latencies, 0.5),
+            percentile(latencies, 0.9), percentile(latencies, 0.99), latencies.back(),
+            (double)stats.decodedFrames / trace.size());
+    for (int route = 0; route < ROUTE_COUNT; ++route)
+        fprintf(stdout, " %9ld", stats.requests[route]);
+    fprintf(stdout, " %6ld\n", stats.failed);
+
+    if (frame) {
+        snprintf(buf, sizeof(buf), "/tmp/scrubbench_%s.ppm", name);
+        ppm_save(frame->data[0], frame->linesize[0], width, height, buf);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int64_t> trace, served, seekServed;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input file> <trace file | play | scrub | jump> [requests=300] "
+                        "[forward limit s=0.5]\n", argv[0]);
+        return -1;
+    }
+    int requests = argc >= 4 ? atoi(argv[3]) : 300;
+    double forwardLimit = argc >= 5 ? atof(argv[4]) : 0.5;
+
+    FrameServer probe;
+    if (probe.open(argv[1]) < 0)
+        return -1;
+    const AVStream* video = probe.getStream();
+    AVRational rate = video->avg_frame_rate.num > 0 ? video->avg_frame_rate : video->r_frame_rate;
+    double frameMs = rate.num > 0 ? 1000.0 * rate.den / rate.num : 40.0;
+    int64_t durationMs = probe.getDurationMs();
+    probe.close();
+
+    if (make_trace(argv[2], requests, durationMs, frameMs, &trace) < 0 && read_trace(argv[2], &trace) < 0) {
+        fprintf(stderr, "No requests in trace '%s'\n", argv[2]);
+        return -1;
+    }
+    fprintf(stdout, "%zu requests, %.1f s input, %.2f ms per frame, forward limit %.2f s\n", trace.size(),
+            durationMs / 1000.0, frameMs, forwardLimit);
+
+    fprintf(stdout, "%-12s %8s %8s %8s %8s %8s", "server", "p50 ms", "p90 ms", "p99 ms", "max ms", "dec/req");
+    for (int route = 0; route < ROUTE_COUNT; ++route)
+        fprintf(stdout, " %9s", routeNames[route]);
+    fprintf(stdout, " %6s\n", "failed");
+
+    if (replay(argv[1], trace, forwardLimit, "frameserver", &served) < 0 ||
+        replay(argv[1], trace, -1, "always_seek", &seekServed) < 0)
+        return -1;
+
+    long mismatches = 0;
+    for (size_t i = 0; i < served.size(); ++i)
+        mismatches += served[i] != seekServed[i];
+    if (mismatches)
+        fprintf(stdout, "%ld requests were served different frames\n", mismatches);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file
+ * Random seek latency benchmark.
+ *
+ * Seeks to pseudo random positions of the file (same positions for every file of the same duration)
+ * and measures how long it takes until the frame at the requested position is decoded and scaled.
+ * Run it on the original and on the proxy written by proxytranscode to compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "decodeuntil.h"
+
+extern "C" {
+#include "helper.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+static double percentile(std::vector<double>& sorted, double p)
+{
+    size_t index = (size_t)(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [number of seeks]\n", argv[0]);
+        return -1;
+    }
+    int seeks = argc >= 3 ? atoi(argv[2]) : 100;
+
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
+                                decoder_ctx->height,
+                                decoder_ctx->pix_fmt,
+                                400,
+                                300,
+                                FORMAT,
+                                SWS_BILINEAR,
+                                NULL,
+                                NULL,
+                                NULL
+                            );
+
+    int64_t start_time = video->start_time != AV_NOPTS_VALUE ? video->start_time : 0;
+    int64_t duration = video->duration != AV_NOPTS_VALUE ? video->duration :
+                       av_rescale_q(input_ctx->duration, AV_TIME_BASE_Q, video->time_base);
+    // targets stop at the start of the last frame, later ones would all be served by the last frame
+    AVRational rate = video->avg_frame_rate.num > 0 ? video->avg_frame_rate : video->r_frame_rate;
+    int64_t frameDuration = rate.num > 0 ? av_rescale_q(1, av_inv_q(rate), video->time_base) : 0;
+    duration = FFMAX(duration - frameDuration, 0);
+
+    AVFrame* frame = av_frame_alloc();
+    AVFrame* pFrameRGB = allocateFrame(400, 300, FORMAT);
+    std::vector<double> latencies;
+    long totalDecoded = 0;
+
+    printf("Decoder name: %s\n", decoder->name);
+
+    srand(1);
+    for (int i = 0; i < seeks; ++i) {
+        int64_t target = start_time + (int64_t)(duration * (rand() / (double)RAND_MAX));
+
+        int64_t begin = av_gettime_relative();
+
+        if (av_seek_frame(input_ctx, video_stream, target, AVSEEK_FLAG_BACKWARD) < 0) {
+            fprintf(stderr, "Seek to %ld failed\n", (long)target);
+            continue;
+        }
+        avcodec_flush_buffers(decoder_ctx);
+
+        int decoded = decode_until(input_ctx, decoder_ctx, video_stream, target, frame);
+        if (decoded < 0) {
+            fprintf(stderr, "No frame decoded at %ld\n", (long)target);
+            continue;
+        }
+        totalDecoded += decoded;
+
+        sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+                frame->linesize, 0, frame->height,
+                pFrameRGB->data, pFrameRGB->linesize);
+        av_frame_unref(frame);
+
+        latencies.push_back((av_gettime_relative() - begin) / 1000.0);
+    }
+
+    if (latencies.empty()) {
+        fprintf(stderr, "No successful seek\n");
+        return -1;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (double latency : latencies)
+        sum += latency;
+
+   fprintf(stdout, "Seeks %zu\n", latencies.size());
+   fprintf(stdout, "Decoded frames per seek %f\n", totalDecoded / (double)latencies.size());
+   fprintf(stdout, "Latency avg %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms\n",
+           sum / latencies.size(), percentile(latencies, 0.5), percentile(latencies, 0.95), latencies.back());
+
+    av_freep(&pFrameRGB->opaque);
+    av_frame_free(&pFrameRGB);
+    av_frame_free(&frame);
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file
+ * Shared memory output sink.
+ *
+ * Decodes and scales like swdecode, but sws_scale writes every frame directly into a slot of
+ * a shared memory ring (see shmring.h) instead of saving PPM files. A consumer process (shmreader)
+ * reads the frames in place.
+ * With --synthetic the decoder is skipped and generated frames are published as fast as possible,
+ * to measure the throughput and latency of the ring itself.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "shmring.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+}
+
+int imageNumber = 0;
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+ShmRing ring;
+
+static void publish_frame(AVFrame* frame, struct SwsContext* sws_ctx)
+{
+    ShmSlot* slot = shmRingBeginWrite(&ring);
+    uint8_t* dst[4] = { slot->data, NULL, NULL, NULL };
+    int dstLinesize[4] = { width * 3, 0, 0, 0 };
+
+    sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+            frame->linesize, 0, frame->height,
+            dst, dstLinesize);
+
+    slot->pts = frame->best_effort_timestamp;
+    slot->width = width;
+    slot->height = height;
+    slot->format = FORMAT;
+    slot->linesize = dstLinesize[0];
+    shmRingEndWrite(&ring, slot);
+}
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsContext* sws_ctx)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        publish_frame(frame, sws_ctx);
+        imageNumber += 1;
+
+        av_frame_free(&frame);
+    }
+}
+
+static int publish_synthetic(long count)
+{
+    int dataSize = width * height * 3;
+
+    for (long i = 0; i < count; ++i) {
+        ShmSlot* slot = shmRingBeginWrite(&ring);
+        memset(slot->data, (int)(i & 0xff), dataSize);
+        slot->pts = i;
+        slot->width = width;
+        slot->height = height;
+        slot->format = FORMAT;
+        slot->linesize = width * 3;
+        shmRingEndWrite(&ring, slot);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file | --synthetic <frames>> [slots] [shm name]\n", argv[0]);
+        return -1;
+    }
+    bool synthetic = strcmp(argv[1], "--synthetic") == 0;
+    int argOffset = synthetic ? 1 : 0;
+    uint32_t slots = argc >= 3 + argOffset ? atoi(argv[2 + argOffset]) : 16;
+    const char* shmName = argc >= 4 + argOffset ? argv[3 + argOffset] : SHM_RING_DEFAULT_NAME;
+
+    if (shmRingCreate(&ring, shmName, slots, av_image_get_buffer_size(FORMAT, width, height, 1)) < 0) {
+        fprintf(stderr, "Cannot create shared memory ring '%s'\n", shmName);
+        return -1;
+    }
+
+    if (synthetic) {
+        long count = argc >= 3 ? atol(argv[2]) : 10000;
+        long long start = shmRingNow();
+        publish_synthetic(count);
+        double took = (shmRingNow() - start) / 1e9;
+        fprintf(stdout, "Published %ld frames, %f frames/s\n", count, count / took);
+    } else {
+        if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+            fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+            return -1;
+        }
+
+        if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+            fprintf(stderr, "Cannot find input stream information.\n");
+            return -1;
+        }
+
+        ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+        if (ret < 0) {
+            fprintf(stderr, "Cannot find a video stream in the input file\n");
+            return -1;
+        }
+        video_stream = ret;
+
+        if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+            return AVERROR(ENOMEM);
+
+        video = input_ctx->streams[video_stream];
+        if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+            return -1;
+
+        decoder_ctx->thread_count = 0; // 0 = automatic
+        decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+        if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+            fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+            return -1;
+        }
+
+        struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
+                                    decoder_ctx->height,
+                                    decoder_ctx->pix_fmt,
+                                    width,
+                                    height,
+                                    FORMAT,
+                                    SWS_BILINEAR,
+                                    NULL,
+                                    NULL,
+                                    NULL
+                                );
+
+        long long start = time(NULL);
+        long frames = 0;
+
+        while (ret >= 0) {
+            if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+                break;
+
+            if (video_stream == packet.stream_index)
+                ret = decode_write(decoder_ctx, &packet, sws_ctx);
+
+            av_packet_unref(&packet);
+            frames += 1;
+            if (frames % 30 == 0)  {
+                long long end = time(NULL);
+                int took = (end - start);
+                fprintf(stdout, "FPS %f\n", frames / (double)took);
+            }
+        }
+
+        /* flush the decoder */
+        packet.data = NULL;
+        packet.size = 0;
+        ret = decode_write(decoder_ctx, &packet, sws_ctx);
+        av_packet_unref(&packet);
+
+        long long end = time(NULL);
+        int took = (end - start);
+        fprintf(stdout, "Took %d\n", took);
+        fprintf(stdout, "FPS %f\n", frames / (double)took);
+        fprintf(stdout, "Published %d frames\n", imageNumber);
+
+        sws_freeContext(sws_ctx);
+        avcodec_free_context(&decoder_ctx);
+        avformat_close_input(&input_ctx);
+    }
+
+    ring.header->finished.store(1, std::memory_order_release);
+    shmRingClose(&ring);
+    // readers keep their mapping, new readers cannot attach anymore
+    shm_unlink(shmName);
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * Reference reader of the shared memory frame ring written by shmdecode.
+ *
+ * Frames are consumed in place: the reader waits by spinning on the published frame counter,
+ * reads the slot and validates the seqlock afterwards, so there is no copy and no syscall per frame.
+ * Reports throughput, publish -> consume latency percentiles, and frames lost because the reader was too slow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <immintrin.h>
+#include "shmring.h"
+
+/* Stands in for real work on the frame, reads every pixel */
+static uint64_t consume_frame(const ShmSlot* slot)
+{
+    const uint64_t* p = (const uint64_t*)slot->data;
+    size_t words = (size_t)slot->linesize * slot->height / sizeof(uint64_t);
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < words; ++i)
+        sum += p[i];
+    return sum;
+}
+
+static int64_t percentile(std::vector<int64_t>& sorted, double p)
+{
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+int main(int argc, char *argv[])
+{
+    ShmRing ring;
+    const char* shmName = argc >= 2 ? argv[1] : SHM_RING_DEFAULT_NAME;
+
+    fprintf(stdout, "Waiting for '%s'\n", shmName);
+    while (shmRingOpen(&ring, shmName) < 0)
+        usleep(10000);
+
+    ShmRingHeader* header = ring.header;
+    std::vector<int64_t> latencies;
+    uint64_t readIndex = header->writeIndex.load(std::memory_order_acquire);
+    uint64_t consumed = 0, lost = 0, torn = 0;
+    uint64_t checksum = 0;
+    int64_t start = 0;
+    long spins = 0;
+
+    latencies.reserve(1 << 20);
+
+    while (1) {
+        uint64_t writeIndex = header->writeIndex.load(std::memory_order_acquire);
+
+        if (readIndex == writeIndex) {
+            if (header->finished.load(std::memory_order_acquire))
+                break;
+            // busy wait without syscalls, back off only when the writer is idle for long
+            if (++spins < 1000000)
+                _mm_pause();
+            else
+                usleep(100);
+            continue;
+        }
+        spins = 0;
+
+        if (writeIndex - readIndex > header->slotCount) {
+            // overwritten before we got to them
+            lost += writeIndex - readIndex - header->slotCount;
+            readIndex = writeIndex - header->slotCount;
+        }
+
+        ShmSlot* slot = shmRingSlot(&ring, readIndex);
+        uint64_t before = slot->sequence.load(std::memory_order_acquire);
+        int64_t frameNumber = slot->frameNumber;
+        int64_t publishTime = slot->publishTimeNs;
+        uint64_t sum = (before & 1) ? 0 : consume_frame(slot);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot->sequence.load(std::memory_order_relaxed);
+
+        if ((before & 1) || before != after || frameNumber != (int64_t)readIndex) {
+            // the writer lapped us while reading this slot
+            torn += 1;
+            readIndex += 1;
+            continue;
+        }
+
+        int64_t now = shmRingNow();
+        if (consumed == 0)
+            start = now;
+        latencies.push_back(now - publishTime);
+        checksum += sum;
+        consumed += 1;
+        readIndex += 1;
+    }
+
+    double took = (shmRingNow() - start) / 1e9;
+    fprintf(stdout, "Consumed %llu frames, lost %llu, torn %llu, %f frames/s (checksum %llx)\n",
+            (unsigned long long)consumed, (unsigned long long)lost, (unsigned long long)torn,
+            consumed / took, (unsigned long long)checksum);
+
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        fprintf(stdout, "Latency p50 %.2f us, p99 %.2f us, max %.2f us\n",
+                percentile(latencies, 0.5) / 1000.0, percentile(latencies, 0.99) / 1000.0,
+                latencies.back() / 1000.0);
+    }
+
+    shmRingClose(&ring);
+    return 0;
+}
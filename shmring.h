@@ -0,0 +1,166 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+/**
+ * Shared memory frame ring between a writer process (shmdecode) and any number of readers (shmreader).
+ *
+ * The ring is a POSIX shared memory object of fixed size slots. Every slot has a seqlock: the writer
+ * makes the sequence odd, writes the metadata and the pixels in place, then makes it even again.
+ * A reader checks that the sequence was even and unchanged around its read, so it never needs a lock,
+ * a copy or a syscall per frame. The writer never waits for readers, a slow reader loses frames.
+ */
+
+#define SHM_RING_MAGIC 0x52494e47u
+#define SHM_RING_DEFAULT_NAME "/ffmpeg-sample-frames"
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t slotCount;
+    uint32_t slotStride;
+    uint32_t dataSize;
+    alignas(64) std::atomic<uint64_t> writeIndex; // number of published frames
+    std::atomic<uint32_t> finished;
+};
+
+struct ShmSlot
+{
+    alignas(64) std::atomic<uint64_t> sequence;
+    int64_t pts;
+    int64_t frameNumber;
+    int64_t publishTimeNs; // CLOCK_MONOTONIC, comparable between processes
+    int32_t width;
+    int32_t height;
+    int32_t format;
+    int32_t linesize;
+    alignas(64) uint8_t data[];
+};
+
+struct ShmRing
+{
+    ShmRingHeader* header;
+    uint8_t* base;
+    size_t mappedSize;
+};
+
+static inline int64_t shmRingNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline ShmSlot* shmRingSlot(const ShmRing* ring, uint64_t index)
+{
+    return (ShmSlot*)(ring->base + sizeof(ShmRingHeader) + (index % ring->header->slotCount) * ring->header->slotStride);
+}
+
+static size_t shmRingSize(uint32_t slotCount, uint32_t slotStride)
+{
+    return sizeof(ShmRingHeader) + (size_t)slotCount * slotStride;
+}
+
+static int shmRingCreate(ShmRing* ring, const char* name, uint32_t slotCount, uint32_t dataSize)
+{
+    uint32_t slotStride = (sizeof(ShmSlot) + dataSize + 4095) & ~4095u;
+    size_t size = shmRingSize(slotCount, slotStride);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0666);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return -1;
+
+    ring->base = (uint8_t*)mapped;
+    ring->header = (ShmRingHeader*)mapped;
+    ring->mappedSize = size;
+
+    ring->header->slotCount = slotCount;
+    ring->header->slotStride = slotStride;
+    ring->header->dataSize = dataSize;
+    ring->header->writeIndex.store(0, std::memory_order_relaxed);
+    ring->header->finished.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slotCount; ++i)
+        shmRingSlot(ring, i)->sequence.store(0, std::memory_order_relaxed);
+
+    // readers only trust the layout once the magic is visible
+    std::atomic_thread_fence(std::memory_order_release);
+    ring->header->magic = SHM_RING_MAGIC;
+    return 0;
+}
+
+static int shmRingOpen(ShmRing* ring, const char* name)
+{
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    // the writer may not have sized it yet, touching the mapping would SIGBUS
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ShmRingHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    ShmRingHeader* header = (ShmRingHeader*)mmap(NULL, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED || header->magic != SHM_RING_MAGIC) {
+        if (header != MAP_FAILED)
+            munmap(header, sizeof(ShmRingHeader));
+        close(fd);
+        return -1;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    size_t size = shmRingSize(header->slotCount, header->slotStride);
+    munmap(header, sizeof(ShmRingHeader));
+
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return -1;
+
+    ring->base = (uint8_t*)mapped;
+    ring->header = (ShmRingHeader*)mapped;
+    ring->mappedSize = size;
+    return 0;
+}
+
+static void shmRingClose(ShmRing* ring)
+{
+    munmap(ring->base, ring->mappedSize);
+    ring->base = NULL;
+    ring->header = NULL;
+}
+
+/* Writer: returns the slot of the next frame with its seqlock taken, write pixels into slot->data */
+static ShmSlot* shmRingBeginWrite(ShmRing* ring)
+{
+    uint64_t index = ring->header->writeIndex.load(std::memory_order_relaxed);
+    ShmSlot* slot = shmRingSlot(ring, index);
+
+    slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot;
+}
+
+static void shmRingEndWrite(ShmRing* ring, ShmSlot* slot)
+{
+    uint64_t index = ring->header->writeIndex.load(std::memory_order_relaxed);
+
+    slot->frameNumber = index;
+    slot->publishTimeNs = shmRingNow();
+    slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    ring->header->writeIndex.store(index + 1, std::memory_order_release);
+}
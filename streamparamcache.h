@@ -0,0 +1,281 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <vector>
+#include "xxhash.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+/**
+ * Per file cache of the probed stream parameters, for fast opening of clips that were opened before.
+ *
+ * avformat_find_stream_info reads and decodes the beginning of every stream to fill in what the
+ * container header does not say (pixel format, frame rate, ...), which costs hundreds of milliseconds
+ * on network storage. After the first full probe the demuxer name and the codec parameters of all
+ * streams are stored, keyed by the absolute path and invalidated when the size or mtime changes.
+ * On a later open the demuxer is forced, format probing is skipped and the parameters are restored
+ * into the streams, so they go to the AVCodecContext with the usual avcodec_parameters_to_context.
+ */
+
+#define STREAM_PARAM_CACHE_MAGIC "STRMPAR1"
+
+struct StreamParamFileHeader
+{
+    char magic[8];
+    int64_t fileSize;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    char formatName[64];
+    int32_t streamCount;
+};
+
+struct StreamParamRecord
+{
+    int32_t codecType;
+    int32_t codecId;
+    uint32_t codecTag;
+    int32_t format;
+    int64_t bitRate;
+    int32_t bitsPerCodedSample;
+    int32_t bitsPerRawSample;
+    int32_t profile;
+    int32_t level;
+    int32_t width;
+    int32_t height;
+    AVRational sampleAspectRatio;
+    AVRational timeBase;
+    AVRational avgFrameRate;
+    AVRational realFrameRate;
+    int32_t fieldOrder;
+    int32_t colorRange;
+    int32_t colorPrimaries;
+    int32_t colorTrc;
+    int32_t colorSpace;
+    int32_t chromaLocation;
+    int32_t videoDelay;
+    int32_t sampleRate;
+    int32_t channels;
+    int32_t blockAlign;
+    int32_t frameSize;
+    int32_t extradataSize;
+};
+
+struct StreamParamCacheEntry
+{
+    StreamParamFileHeader header;
+    std::vector<StreamParamRecord> streams;
+    std::vector<std::vector<uint8_t> > extradata;
+};
+
+static int streamParamCachePath(const char* dir, const char* filename, char* path, size_t size)
+{
+    char absolute[PATH_MAX];
+    if (!realpath(filename, absolute))
+        return -1;
+    snprintf(path, size, "%s/%016llx.params", dir, (unsigned long long)xxh64(absolute, strlen(absolute), 0));
+    return 0;
+}
+
+static int streamParamStat(const char* filename, StreamParamFileHeader* header)
+{
+    struct stat st;
+    if (stat(filename, &st) < 0)
+        return -1;
+    header->fileSize = st.st_size;
+    header->mtimeSec = st.st_mtim.tv_sec;
+    header->mtimeNsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/* Returns 0 and fills entry when there is a valid entry for the current version of the file */
+static int streamParamCacheLoad(const char* dir, const char* filename, StreamParamCacheEntry* entry)
+{
+    char path[1024];
+    StreamParamFileHeader current;
+
+    if (streamParamCachePath(dir, filename, path, sizeof(path)) < 0 || streamParamStat(filename, &current) < 0)
+        return -1;
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return -1;
+
+    StreamParamFileHeader* header = &entry->header;
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, STREAM_PARAM_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->fileSize != current.fileSize || header->mtimeSec != current.mtimeSec ||
+        header->mtimeNsec != current.mtimeNsec ||
+        header->streamCount <= 0 || header->streamCount > 1024) {
+        fclose(file);
+        return -1;
+    }
+    header->formatName[sizeof(header->formatName) - 1] = 0;
+
+    entry->streams.resize(header->streamCount);
+    entry->extradata.resize(header->streamCount);
+    for (int i = 0; i < header->streamCount; ++i) {
+        StreamParamRecord* record = &entry->streams[i];
+        if (fread(record, sizeof(*record), 1, file) != 1 ||
+            record->extradataSize < 0 || record->extradataSize > 16 * 1024 * 1024) {
+            fclose(file);
+            return -1;
+        }
+        entry->extradata[i].resize(record->extradataSize);
+        if (record->extradataSize > 0 &&
+            fread(entry->extradata[i].data(), record->extradataSize, 1, file) != 1) {
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int streamParamCacheStore(const char* dir, const char* filename, const AVFormatContext* input_ctx)
+{
+    char path[1024];
+    char tmpPath[1024];
+    StreamParamFileHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STREAM_PARAM_CACHE_MAGIC, sizeof(header.magic));
+    if (streamParamCachePath(dir, filename, path, sizeof(path)) < 0 || streamParamStat(filename, &header) < 0)
+        return -1;
+    snprintf(header.formatName, sizeof(header.formatName), "%s", input_ctx->iformat->name);
+    header.streamCount = input_ctx->nb_streams;
+
+    mkdir(dir, 0777);
+    snprintf(tmpPath, sizeof(tmpPath), "%s/.tmp.XXXXXX", dir);
+    int fd = mkstemp(tmpPath);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create cache file in '%s'\n", dir);
+        return -1;
+    }
+    fchmod(fd, 0644);
+    FILE* file = fdopen(fd, "wb");
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (unsigned int i = 0; i < input_ctx->nb_streams && ok; ++i) {
+        const AVStream* stream = input_ctx->streams[i];
+        const AVCodecParameters* par = stream->codecpar;
+        StreamParamRecord record;
+
+        memset(&record, 0, sizeof(record));
+        record.codecType = par->codec_type;
+        record.codecId = par->codec_id;
+        record.codecTag = par->codec_tag;
+        record.format = par->format;
+        record.bitRate = par->bit_rate;
+        record.bitsPerCodedSample = par->bits_per_coded_sample;
+        record.bitsPerRawSample = par->bits_per_raw_sample;
+        record.profile = par->profile;
+        record.level = par->level;
+        record.width = par->width;
+        record.height = par->height;
+        record.sampleAspectRatio = par->sample_aspect_ratio;
+        record.timeBase = stream->time_base;
+        record.avgFrameRate = stream->avg_frame_rate;
+        record.realFrameRate = stream->r_frame_rate;
+        record.fieldOrder = par->field_order;
+        record.colorRange = par->color_range;
+        record.colorPrimaries = par->color_primaries;
+        record.colorTrc = par->color_trc;
+        record.colorSpace = par->color_space;
+        record.chromaLocation = par->chroma_location;
+        record.videoDelay = par->video_delay;
+        record.sampleRate = par->sample_rate;
+        record.channels = par->ch_layout.nb_channels;
+        record.blockAlign = par->block_align;
+        record.frameSize = par->frame_size;
+        record.extradataSize = par->extradata_size;
+
+        ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+             (par->extradata_size == 0 || fwrite(par->extradata, par->extradata_size, 1, file) == 1);
+    }
+
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Cannot write cache file '%s'\n", tmpPath);
+        unlink(tmpPath);
+        return -1;
+    }
+
+    // concurrent opens of the same clip either see the old entry, no entry or the complete new one
+    if (rename(tmpPath, path) < 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+    return 0;
+}
+
+/* The demuxer must have found the same streams in its header as the full probe did */
+static bool streamParamLayoutMatches(const StreamParamCacheEntry* entry, const AVFormatContext* input_ctx)
+{
+    if ((int)input_ctx->nb_streams != entry->header.streamCount)
+        return false;
+    for (unsigned int i = 0; i < input_ctx->nb_streams; ++i) {
+        const AVCodecParameters* par = input_ctx->streams[i]->codecpar;
+        const StreamParamRecord* record = &entry->streams[i];
+        const AVRational timeBase = input_ctx->streams[i]->time_base;
+        if (par->codec_type != record->codecType || par->codec_id != record->codecId ||
+            timeBase.num != record->timeBase.num || timeBase.den != record->timeBase.den)
+            return false;
+    }
+    return true;
+}
+
+/* Overwrites the codec parameters of all streams with the cached full probe result */
+static int streamParamRestore(const StreamParamCacheEntry* entry, AVFormatContext* input_ctx)
+{
+    for (unsigned int i = 0; i < input_ctx->nb_streams; ++i) {
+        AVStream* stream = input_ctx->streams[i];
+        AVCodecParameters* par = stream->codecpar;
+        const StreamParamRecord* record = &entry->streams[i];
+
+        par->codec_tag = record->codecTag;
+        par->format = record->format;
+        par->bit_rate = record->bitRate;
+        par->bits_per_coded_sample = record->bitsPerCodedSample;
+        par->bits_per_raw_sample = record->bitsPerRawSample;
+        par->profile = record->profile;
+        par->level = record->level;
+        par->width = record->width;
+        par->height = record->height;
+        par->sample_aspect_ratio = record->sampleAspectRatio;
+        par->field_order = (AVFieldOrder)record->fieldOrder;
+        par->color_range = (AVColorRange)record->colorRange;
+        par->color_primaries = (AVColorPrimaries)record->colorPrimaries;
+        par->color_trc = (AVColorTransferCharacteristic)record->colorTrc;
+        par->color_space = (AVColorSpace)record->colorSpace;
+        par->chroma_location = (AVChromaLocation)record->chromaLocation;
+        par->video_delay = record->videoDelay;
+        par->sample_rate = record->sampleRate;
+        par->block_align = record->blockAlign;
+        par->frame_size = record->frameSize;
+        if (record->channels > 0 && par->ch_layout.nb_channels != record->channels) {
+            av_channel_layout_uninit(&par->ch_layout);
+            av_channel_layout_default(&par->ch_layout, record->channels);
+        }
+
+        if (record->extradataSize > 0 && par->extradata_size == 0) {
+            par->extradata = (uint8_t*)av_mallocz(record->extradataSize + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!par->extradata)
+                return AVERROR(ENOMEM);
+            memcpy(par->extradata, entry->extradata[i].data(), record->extradataSize);
+            par->extradata_size = record->extradataSize;
+        }
+
+        stream->avg_frame_rate = record->avgFrameRate;
+        stream->r_frame_rate = record->realFrameRate;
+    }
+    return 0;
+}
@@ -34,10 +34,16 @@
 
 #include <stdio.h>
 #include "debugimage.h"
+#include "streamparamcache.h"
+#include "waveform.h"
+#include "frameprofiler.h"
+#include "checksumlog.h"
+#include "allocaccounting.h"
 
 
 extern "C" {
 #include "helper.h"
+#include "probes.h"
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavformat/avformat.h>
@@ -46,9 +52,13 @@ extern "C" {
 #include <libavutil/opt.h>
 #include <libavutil/avassert.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 
 int imageNumber = 0;
 char buf[200];
+int64_t firstFrameTime = 0;
+FrameProfiler* profiler = NULL;
+ChecksumLog* checksumLog = NULL;
 
 AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
 
@@ -60,7 +70,12 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsConte
     int size;
     int ret = 0;
 
+    PROBE_TIMER_START(send_packet);
+    int64_t sendStart = profiler ? av_gettime_relative() : 0;
     ret = avcodec_send_packet(avctx, packet);
+    PROBE_TIMED3(send_packet, packet->pts, packet->size);
+    if (profiler && ret >= 0 && packet->size > 0)
+        profiler->packetSent(packet, av_gettime_relative() - sendStart);
     if (ret < 0) {
         fprintf(stderr, "Error during decoding\n");
         return ret;
@@ -73,6 +88,8 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsConte
             return -1;
         }
 
+        PROBE_TIMER_START(receive_frame);
+        int64_t receiveStart = profiler ? av_gettime_relative() : 0;
         ret = avcodec_receive_frame(avctx, frame);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             av_frame_free(&frame);
@@ -83,20 +100,33 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsConte
             return -1;
         }
 
+        PROBE_TIMED3(receive_frame, imageNumber, frame->pts);
+        if (profiler)
+            profiler->frameReceived(frame, av_gettime_relative() - receiveStart);
+        if (firstFrameTime == 0)
+            firstFrameTime = av_gettime_relative();
+
         tmp_frame = frame;
 
 
         AVFrame* pFrameRGB=allocateFrame(400, 300, FORMAT);
 
+        PROBE_TIMER_START(sws_scale);
         sws_scale(sws_ctx, (uint8_t const * const *)tmp_frame->data,
                 tmp_frame->linesize, 0, tmp_frame->height,
                 pFrameRGB->data, pFrameRGB->linesize);
+        PROBE_TIMED3(sws_scale, imageNumber, tmp_frame->pts);
+        if (checksumLog)
+            checksumLog->add(tmp_frame->pts, tmp_frame, pFrameRGB->data, pFrameRGB->linesize);
 
         imageNumber += 1;
+        ALLOC_ACCOUNTING_FRAME();
 
         if (imageNumber % 100 == 0) {
             snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "swdecode", imageNumber);
+            PROBE_TIMER_START(ppm_save);
             ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], pFrameRGB->width, pFrameRGB->height, buf);
+            PROBE_TIMED3(ppm_save, imageNumber, pFrameRGB->width * pFrameRGB->height * 3);
         }
 
         av_freep(&pFrameRGB->opaque);
@@ -109,6 +139,52 @@ static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsConte
 
 }
 
+/*
+ * With a cache dir a clip opened before skips format probing and avformat_find_stream_info,
+ * its stream parameters come from the cache. Anything unexpected falls back to the full probe.
+ */
+static int open_input(AVFormatContext** input_ctx, const char* filename, const char* cacheDir, bool* cacheHit)
+{
+    StreamParamCacheEntry entry;
+
+    *cacheHit = false;
+    if (cacheDir && streamParamCacheLoad(cacheDir, filename, &entry) == 0) {
+        const AVInputFormat* format = av_find_input_format(entry.header.formatName);
+        AVDictionary* options = NULL;
+
+        av_dict_set(&options, "probesize", "65536", 0);
+        av_dict_set(&options, "analyzeduration", "100000", 0);
+        if (format && avformat_open_input(input_ctx, filename, format, &options) == 0) {
+            // demuxers without a header (e.g. MPEG-TS) only create their streams from packets
+            if (((*input_ctx)->ctx_flags & AVFMTCTX_NOHEADER) || (int)(*input_ctx)->nb_streams != entry.header.streamCount)
+                avformat_find_stream_info(*input_ctx, NULL);
+
+            if (streamParamLayoutMatches(&entry, *input_ctx) && streamParamRestore(&entry, *input_ctx) == 0) {
+                *cacheHit = true;
+                av_dict_free(&options);
+                return 0;
+            }
+            fprintf(stderr, "Cached stream parameters do not match, probing again\n");
+            avformat_close_input(input_ctx);
+        }
+        av_dict_free(&options);
+    }
+
+    if (avformat_open_input(input_ctx, filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", filename);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(*input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    if (cacheDir)
+        streamParamCacheStore(cacheDir, filename, *input_ctx);
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     AVFormatContext *input_ctx = NULL;
@@ -118,23 +194,47 @@ int main(int argc, char *argv[])
     const AVCodec *decoder = NULL;
     AVPacket packet;
     int i;
+    const char* cacheDir = NULL;
+    const char* waveformFile = NULL;
+    const char* profileFile = NULL;
+    const char* checksumFile = NULL;
+    const char* dumpFile = NULL;
+    int64_t dumpFromPts = 0;
+    bool hashPlanes = false;
+    int threads = 0;
+    bool cacheHit = false;
 
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <input file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <input file> [--fast-open [cache dir]] [--waveform <peaks file>] [--profile <csv file>] [--threads N] [--checksums <log> [--planes] [--dump <raw file> [from pts]]]\n", argv[0]);
         return -1;
     }
+    for (i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--fast-open") == 0)
+            cacheDir = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "/tmp/streamparamcache";
+        else if (strcmp(argv[i], "--waveform") == 0 && i + 1 < argc)
+            waveformFile = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profileFile = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--checksums") == 0 && i + 1 < argc)
+            checksumFile = argv[++i];
+        else if (strcmp(argv[i], "--planes") == 0)
+            hashPlanes = true;
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpFile = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                dumpFromPts = strtoll(argv[++i], NULL, 10);
+        }
+    }
 
+    int64_t openStart = av_gettime_relative();
 
     /* open the input file */
-    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
-        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+    if (open_input(&input_ctx, argv[1], cacheDir, &cacheHit) < 0)
         return -1;
-    }
 
-    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
-        fprintf(stderr, "Cannot find input stream information.\n");
-        return -1;
-    }
+    int64_t openEnd = av_gettime_relative();
 
     av_dump_format(input_ctx, 0, argv[1], 0);
 
@@ -153,13 +253,28 @@ int main(int argc, char *argv[])
     if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
         return -1;
 
-    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_count = threads; // 0 = automatic
     decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
 
     if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
         fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
         return -1;
     }
+    int64_t decoderOpenEnd = av_gettime_relative();
+
+    if (profileFile)
+        profiler = new FrameProfiler(decoder_ctx);
+
+    if (checksumFile) {
+        checksumLog = new ChecksumLog();
+        if (checksumLog->open(checksumFile, hashPlanes, 400, 300, FORMAT) < 0 ||
+            (dumpFile && checksumLog->openDump(dumpFile, dumpFromPts) < 0))
+            return -1;
+    }
+
+    WaveformExtractor waveform;
+    if (waveformFile && waveform.open(input_ctx, video_stream) < 0)
+        waveformFile = NULL;
 
     struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
                                 decoder_ctx->height,
@@ -183,11 +298,15 @@ int main(int argc, char *argv[])
     /* actual decoding and dump the raw data */
     while (ret >= 0) {
       //  fprintf(stdout, "Frame .. \n");
+        PROBE_TIMER_START(packet_read);
         if ((ret = av_read_frame(input_ctx, &packet)) < 0)
             break;
+        PROBE_TIMED4(packet_read, packet.stream_index, packet.pts, packet.size);
 
         if (video_stream == packet.stream_index)
             ret = decode_write(decoder_ctx, &packet, sws_ctx);
+        else if (waveformFile && waveform.getStreamIndex() == packet.stream_index)
+            waveform.push(&packet);
 
         av_packet_unref(&packet);
         frames += 1;
@@ -203,18 +322,31 @@ int main(int argc, char *argv[])
     packet.size = 0;
     ret = decode_write(decoder_ctx, &packet, sws_ctx);
     av_packet_unref(&packet);
+    if (waveformFile)
+        waveform.finish(waveformFile);
 
 
 
    long long end = time(NULL);
    int took = (end - start);
    fprintf(stdout, "Took %d\n", took);
+   if (profiler) {
+       profiler->printSummary(decoder_ctx, video->avg_frame_rate);
+       profiler->writeLog(profileFile);
+       delete profiler;
+   }
+   delete checksumLog;
    fprintf(stdout, "FPS %f\n", frames / (double)took);
+   if (firstFrameTime)
+       fprintf(stdout, "Time to first frame %.1f ms (open %.1f ms %s, decoder open %.1f ms, first decode %.1f ms)\n",
+               (firstFrameTime - openStart) / 1000.0, (openEnd - openStart) / 1000.0,
+               !cacheDir ? "full probe" : cacheHit ? "cached parameters" : "full probe, cache miss",
+               (decoderOpenEnd - openEnd) / 1000.0, (firstFrameTime - decoderOpenEnd) / 1000.0);
 
 
     avcodec_free_context(&decoder_ctx);
     avformat_close_input(&input_ctx);
 
-    return 0;
+    return ALLOC_ACCOUNTING_REPORT();
 }
 }
\ No newline at end of file
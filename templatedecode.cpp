@@ -0,0 +1,603 @@
+/**
+ * @file
+ * Compile-time specialized decode pipeline.
+ *
+ * The per frame path is a template over three policies:
+ *  - input backend: software decoding, VAAPI + av_hwframe_transfer_data, VAAPI + scale_vaapi filter
+ *  - conversion kernel: sws_scale with source/destination pixel format and flags fixed at compile time
+ *  - output sink: PPM sample every 100 frames (like the other samples) or discard
+ * The common combinations are explicitly instantiated and one is picked once at startup, so the inner
+ * loop has no per frame dispatch, no function pointers and touches no global state.
+ *
+ * With --dispatch the same work runs through a runtime dispatched path (backend switch and function
+ * pointers per frame, like the other samples) for comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/time.h>
+}
+
+enum Backend { BACKEND_SW, BACKEND_HW_TRANSFER, BACKEND_HW_FILTER };
+
+static const int OUTPUT_WIDTH = 400;
+static const int OUTPUT_HEIGHT = 300;
+static const AVPixelFormat OUTPUT_FORMAT = AV_PIX_FMT_RGB24;
+
+static enum AVPixelFormat hw_pix_fmt;
+static AVBufferRef *hw_device_ctx = NULL;
+
+static enum AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts)
+{
+    const enum AVPixelFormat *p;
+
+    for (p = pix_fmts; *p != -1; p++) {
+        if (*p == hw_pix_fmt)
+            return *p;
+    }
+
+    fprintf(stderr, "Failed to get HW surface format.\n");
+    return AV_PIX_FMT_NONE;
+}
+
+/* Input backends: turn a decoded frame into zero or more software frames */
+
+struct SoftwareInput
+{
+    void outputSize(const AVCodecContext* avctx, int* width, int* height)
+    {
+        *width = avctx->width;
+        *height = avctx->height;
+    }
+
+    template <typename OnFrame>
+    int process(AVFrame* decoded, OnFrame&& onFrame)
+    {
+        onFrame(decoded);
+        return 0;
+    }
+
+    void close() {}
+};
+
+struct HwTransferInput
+{
+    AVFrame* sw_frame = av_frame_alloc();
+
+    void outputSize(const AVCodecContext* avctx, int* width, int* height)
+    {
+        *width = avctx->width;
+        *height = avctx->height;
+    }
+
+    template <typename OnFrame>
+    int process(AVFrame* decoded, OnFrame&& onFrame)
+    {
+        if (av_hwframe_transfer_data(sw_frame, decoded, 0) < 0) {
+            fprintf(stderr, "Error transferring the data to system memory\n");
+            return -1;
+        }
+        onFrame(sw_frame);
+        av_frame_unref(sw_frame);
+        return 0;
+    }
+
+    void close()
+    {
+        av_frame_free(&sw_frame);
+    }
+};
+
+struct HwFilterInput
+{
+    AVFilterGraph* filter_graph = NULL;
+    AVFilterContext* buffersrc_ctx = NULL;
+    AVFilterContext* buffersink_ctx = NULL;
+    AVFrame* filt_frame = av_frame_alloc();
+
+    void outputSize(const AVCodecContext* avctx, int* width, int* height)
+    {
+        *width = OUTPUT_WIDTH;
+        *height = OUTPUT_HEIGHT;
+    }
+
+    int init(const AVFrame* decoded)
+    {
+        char args[512];
+        AVFilterInOut *outputs = NULL;
+        AVFilterInOut *inputs = NULL;
+        int ret;
+
+        snprintf(args, sizeof(args), "scale_vaapi=%d:%d,hwdownload,format=yuv420p", OUTPUT_WIDTH, OUTPUT_HEIGHT);
+
+        filter_graph = avfilter_graph_alloc();
+        if ((ret = avfilter_graph_parse2(filter_graph, args, &inputs, &outputs)) < 0)
+            return ret;
+        for (unsigned i = 0; i < filter_graph->nb_filters; ++i)
+            filter_graph->filters[i]->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+
+        snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=1/60:pixel_aspect=1/1",
+                 decoded->width, decoded->height, hw_pix_fmt);
+        if ((ret = avfilter_graph_create_filter(&buffersrc_ctx, avfilter_get_by_name("buffer"), "in",
+                                                args, NULL, filter_graph)) < 0)
+            return ret;
+
+        AVBufferSrcParameters *par = av_buffersrc_parameters_alloc();
+        if (!par)
+            return AVERROR(ENOMEM);
+        par->format = AV_PIX_FMT_NONE;
+        par->hw_frames_ctx = decoded->hw_frames_ctx;
+        ret = av_buffersrc_parameters_set(buffersrc_ctx, par);
+        av_freep(&par);
+        if (ret < 0)
+            return ret;
+
+        if ((ret = avfilter_graph_create_filter(&buffersink_ctx, avfilter_get_by_name("buffersink"), "out",
+                                                NULL, NULL, filter_graph)) < 0)
+            return ret;
+
+        if ((ret = avfilter_link(buffersrc_ctx, 0, inputs->filter_ctx, inputs->pad_idx)) < 0)
+            return ret;
+        if ((ret = avfilter_link(outputs->filter_ctx, outputs->pad_idx, buffersink_ctx, 0)) < 0)
+            return ret;
+        avfilter_inout_free(&inputs);
+        avfilter_inout_free(&outputs);
+
+        return avfilter_graph_config(filter_graph, NULL);
+    }
+
+    template <typename OnFrame>
+    int process(AVFrame* decoded, OnFrame&& onFrame)
+    {
+        // the graph needs the hw frames context of the decoder output
+        if (!filter_graph && init(decoded) < 0) {
+            fprintf(stderr, "Init filter fails\n");
+            return -1;
+        }
+
+        if (av_buffersrc_add_frame_flags(buffersrc_ctx, decoded, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+            fprintf(stderr, "Error while feeding the filtergraph\n");
+            return -1;
+        }
+
+        while (av_buffersink_get_frame(buffersink_ctx, filt_frame) >= 0) {
+            onFrame(filt_frame);
+            av_frame_unref(filt_frame);
+        }
+        return 0;
+    }
+
+    void close()
+    {
+        av_frame_free(&filt_frame);
+        avfilter_graph_free(&filter_graph);
+    }
+};
+
+/* Conversion kernels */
+
+template <AVPixelFormat SrcFormat, AVPixelFormat DstFormat, int Flags>
+struct SwsConverter
+{
+    static const AVPixelFormat sourceFormat = SrcFormat;
+    struct SwsContext* sws_ctx = NULL;
+
+    int init(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+    {
+        sws_ctx = sws_getContext(srcWidth, srcHeight, SrcFormat, dstWidth, dstHeight, DstFormat, Flags, NULL, NULL, NULL);
+        return sws_ctx ? 0 : -1;
+    }
+
+    void convert(const AVFrame* src, AVFrame* dst)
+    {
+        sws_scale(sws_ctx, (uint8_t const * const *)src->data, src->linesize, 0, src->height,
+                  dst->data, dst->linesize);
+    }
+
+    void close()
+    {
+        sws_freeContext(sws_ctx);
+    }
+};
+
+/* Output sinks */
+
+struct PpmSink
+{
+    int imageNumber = 0;
+    char buf[200];
+
+    void consume(const AVFrame* frame)
+    {
+        imageNumber += 1;
+        if (imageNumber % 100 == 0) {
+            snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "templatedecode", imageNumber);
+            ppm_save(frame->data[0], frame->linesize[0], frame->width, frame->height, buf);
+        }
+    }
+};
+
+struct NullSink
+{
+    int imageNumber = 0;
+
+    void consume(const AVFrame* frame)
+    {
+        imageNumber += 1;
+    }
+};
+
+template <typename Input, typename Converter, typename Sink>
+class Pipeline
+{
+public:
+    int run(AVFormatContext* input_ctx, AVCodecContext* decoder_ctx, int video_stream)
+    {
+        AVPacket packet;
+        int width, height;
+        int ret;
+
+        input.outputSize(decoder_ctx, &width, &height);
+        if (converter.init(width, height, OUTPUT_WIDTH, OUTPUT_HEIGHT) < 0) {
+            fprintf(stderr, "Cannot create scaler\n");
+            return -1;
+        }
+        output = allocateFrame(OUTPUT_WIDTH, OUTPUT_HEIGHT, OUTPUT_FORMAT);
+        frame = av_frame_alloc();
+
+        while ((ret = av_read_frame(input_ctx, &packet)) >= 0) {
+            if (packet.stream_index == video_stream)
+                ret = decode_write(decoder_ctx, &packet);
+            av_packet_unref(&packet);
+            if (ret < 0)
+                break;
+        }
+        ret = decode_write(decoder_ctx, NULL);
+
+        input.close();
+        converter.close();
+        av_frame_free(&frame);
+        av_freep(&output->opaque);
+        av_frame_free(&output);
+        return sink.imageNumber;
+    }
+
+private:
+    int decode_write(AVCodecContext* avctx, AVPacket* packet)
+    {
+        int ret = avcodec_send_packet(avctx, packet);
+        if (ret < 0) {
+            fprintf(stderr, "Error during decoding\n");
+            return ret;
+        }
+
+        while ((ret = avcodec_receive_frame(avctx, frame)) >= 0) {
+            ret = input.process(frame, [this](AVFrame* swFrame) {
+                converter.convert(swFrame, output);
+                sink.consume(output);
+            });
+            av_frame_unref(frame);
+            if (ret < 0)
+                return ret;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+    }
+
+    Input input;
+    Converter converter;
+    Sink sink;
+    AVFrame* frame;
+    AVFrame* output;
+};
+
+typedef SwsConverter<AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGB24, SWS_BILINEAR> Yuv420pToRgb;
+typedef SwsConverter<AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_RGB24, SWS_BILINEAR> Yuvj420pToRgb;
+typedef SwsConverter<AV_PIX_FMT_YUV422P, AV_PIX_FMT_RGB24, SWS_BILINEAR> Yuv422pToRgb;
+typedef SwsConverter<AV_PIX_FMT_NV12, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR> Nv12ToRgbFast;
+typedef SwsConverter<AV_PIX_FMT_P010, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR> P010ToRgbFast;
+typedef SwsConverter<AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR> Yuv420pToRgbFast;
+
+template class Pipeline<SoftwareInput, Yuv420pToRgb, PpmSink>;
+template class Pipeline<SoftwareInput, Yuv420pToRgb, NullSink>;
+template class Pipeline<SoftwareInput, Yuvj420pToRgb, PpmSink>;
+template class Pipeline<SoftwareInput, Yuvj420pToRgb, NullSink>;
+template class Pipeline<SoftwareInput, Yuv422pToRgb, PpmSink>;
+template class Pipeline<SoftwareInput, Yuv422pToRgb, NullSink>;
+template class Pipeline<HwTransferInput, Nv12ToRgbFast, PpmSink>;
+template class Pipeline<HwTransferInput, Nv12ToRgbFast, NullSink>;
+template class Pipeline<HwTransferInput, P010ToRgbFast, PpmSink>;
+template class Pipeline<HwTransferInput, P010ToRgbFast, NullSink>;
+template class Pipeline<HwFilterInput, Yuv420pToRgbFast, PpmSink>;
+template class Pipeline<HwFilterInput, Yuv420pToRgbFast, NullSink>;
+
+template <typename Input, typename Converter>
+static int run_with_sink(bool nullSink, AVFormatContext* input_ctx, AVCodecContext* decoder_ctx, int video_stream)
+{
+    if (nullSink) {
+        Pipeline<Input, Converter, NullSink> pipeline;
+        return pipeline.run(input_ctx, decoder_ctx, video_stream);
+    }
+    Pipeline<Input, Converter, PpmSink> pipeline;
+    return pipeline.run(input_ctx, decoder_ctx, video_stream);
+}
+
+/*
+ * Format av_hwframe_transfer_data downloads the surfaces in (the first transfer format), known only once the
+ * decoder has created its frames context. Decodes up to the first frame and rewinds the input.
+ */
+static AVPixelFormat probe_download_format(AVFormatContext* input_ctx, AVCodecContext* decoder_ctx, int video_stream)
+{
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    AVPacket packet;
+    AVFrame* frame = av_frame_alloc();
+    int ret = 0;
+
+    while (format == AV_PIX_FMT_NONE && ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+        if (packet.stream_index == video_stream && avcodec_send_packet(decoder_ctx, &packet) >= 0 &&
+            avcodec_receive_frame(decoder_ctx, frame) >= 0) {
+            AVPixelFormat* formats = NULL;
+            if (frame->hw_frames_ctx &&
+                av_hwframe_transfer_get_formats(frame->hw_frames_ctx, AV_HWFRAME_TRANSFER_DIRECTION_FROM, &formats, 0) >= 0)
+                format = formats[0];
+            av_freep(&formats);
+            av_frame_unref(frame);
+        }
+        av_packet_unref(&packet);
+    }
+    av_frame_free(&frame);
+
+    AVStream* video = input_ctx->streams[video_stream];
+    av_seek_frame(input_ctx, video_stream, video->start_time != AV_NOPTS_VALUE ? video->start_time : 0, AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(decoder_ctx);
+    return format;
+}
+
+/* Picks the specialization once, returns the number of frames or -1 if there is none for this input */
+static int run_specialized(Backend backend, bool nullSink, AVPixelFormat downloadFormat, AVFormatContext* input_ctx,
+                           AVCodecContext* decoder_ctx, int video_stream)
+{
+    switch (backend) {
+    case BACKEND_SW:
+        switch (decoder_ctx->pix_fmt) {
+        case AV_PIX_FMT_YUV420P:
+            return run_with_sink<SoftwareInput, Yuv420pToRgb>(nullSink, input_ctx, decoder_ctx, video_stream);
+        case AV_PIX_FMT_YUVJ420P:
+            return run_with_sink<SoftwareInput, Yuvj420pToRgb>(nullSink, input_ctx, decoder_ctx, video_stream);
+        case AV_PIX_FMT_YUV422P:
+            return run_with_sink<SoftwareInput, Yuv422pToRgb>(nullSink, input_ctx, decoder_ctx, video_stream);
+        default:
+            fprintf(stderr, "No specialization for %s, use --dispatch\n", av_get_pix_fmt_name(decoder_ctx->pix_fmt));
+            return -1;
+        }
+    case BACKEND_HW_TRANSFER:
+        switch (downloadFormat) {
+        case AV_PIX_FMT_NV12:
+            return run_with_sink<HwTransferInput, Nv12ToRgbFast>(nullSink, input_ctx, decoder_ctx, video_stream);
+        case AV_PIX_FMT_P010:
+            return run_with_sink<HwTransferInput, P010ToRgbFast>(nullSink, input_ctx, decoder_ctx, video_stream);
+        default:
+            fprintf(stderr, "No specialization for %s downloads, use --dispatch\n", av_get_pix_fmt_name(downloadFormat));
+            return -1;
+        }
+    case BACKEND_HW_FILTER:
+        return run_with_sink<HwFilterInput, Yuv420pToRgbFast>(nullSink, input_ctx, decoder_ctx, video_stream);
+    }
+    return -1;
+}
+
+/* Runtime dispatched path, for comparison */
+
+struct SwsContext* dispatch_sws_ctx = NULL;
+int dispatch_flags = SWS_BILINEAR;
+AVFrame* dispatch_output = NULL;
+SoftwareInput dispatchSoftware;
+HwTransferInput dispatchTransfer;
+HwFilterInput dispatchFilter;
+PpmSink dispatchPpm;
+NullSink dispatchNull;
+
+static void dispatch_convert(const AVFrame* src, AVFrame* dst)
+{
+    if (!dispatch_sws_ctx) {
+        dispatch_sws_ctx = sws_getContext(src->width, src->height, (AVPixelFormat)src->format,
+                                          OUTPUT_WIDTH, OUTPUT_HEIGHT, OUTPUT_FORMAT,
+                                          dispatch_flags, NULL, NULL, NULL);
+    }
+    sws_scale(dispatch_sws_ctx, (uint8_t const * const *)src->data, src->linesize, 0, src->height,
+              dst->data, dst->linesize);
+}
+
+static void dispatch_ppm(const AVFrame* frame)
+{
+    dispatchPpm.consume(frame);
+}
+
+static void dispatch_null(const AVFrame* frame)
+{
+    dispatchNull.consume(frame);
+}
+
+void (*convert_fn)(const AVFrame*, AVFrame*) = dispatch_convert;
+void (*sink_fn)(const AVFrame*) = NULL;
+
+static void dispatch_frame(AVFrame* swFrame)
+{
+    convert_fn(swFrame, dispatch_output);
+    sink_fn(dispatch_output);
+}
+
+void (*frame_fn)(AVFrame*) = dispatch_frame;
+
+static int dispatch_decode_write(Backend backend, AVCodecContext* avctx, AVPacket* packet, AVFrame* frame)
+{
+    int ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while ((ret = avcodec_receive_frame(avctx, frame)) >= 0) {
+        switch (backend) {
+        case BACKEND_SW:
+            ret = dispatchSoftware.process(frame, frame_fn);
+            break;
+        case BACKEND_HW_TRANSFER:
+            ret = dispatchTransfer.process(frame, frame_fn);
+            break;
+        case BACKEND_HW_FILTER:
+            ret = dispatchFilter.process(frame, frame_fn);
+            break;
+        }
+        av_frame_unref(frame);
+        if (ret < 0)
+            return ret;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int run_dispatched(Backend backend, bool nullSink, AVFormatContext* input_ctx, AVCodecContext* decoder_ctx, int video_stream)
+{
+    AVPacket packet;
+    AVFrame* frame = av_frame_alloc();
+    int ret;
+
+    sink_fn = nullSink ? dispatch_null : dispatch_ppm;
+    dispatch_flags = backend == BACKEND_SW ? SWS_BILINEAR : SWS_FAST_BILINEAR;
+    dispatch_output = allocateFrame(OUTPUT_WIDTH, OUTPUT_HEIGHT, OUTPUT_FORMAT);
+
+    while ((ret = av_read_frame(input_ctx, &packet)) >= 0) {
+        if (packet.stream_index == video_stream)
+            ret = dispatch_decode_write(backend, decoder_ctx, &packet, frame);
+        av_packet_unref(&packet);
+        if (ret < 0)
+            break;
+    }
+    dispatch_decode_write(backend, decoder_ctx, NULL, frame);
+
+    dispatchTransfer.close();
+    dispatchFilter.close();
+    sws_freeContext(dispatch_sws_ctx);
+    av_frame_free(&frame);
+    av_freep(&dispatch_output->opaque);
+    av_frame_free(&dispatch_output);
+    return nullSink ? dispatchNull.imageNumber : dispatchPpm.imageNumber;
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    Backend backend = BACKEND_SW;
+    bool nullSink = false;
+    bool dispatch = false;
+    const char* device = "/dev/dri/renderD128";
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input file> <sw|hwtransfer|hwfilter> [ppm|null] [--dispatch] [device]\n", argv[0]);
+        return -1;
+    }
+    if (strcmp(argv[2], "hwtransfer") == 0)
+        backend = BACKEND_HW_TRANSFER;
+    else if (strcmp(argv[2], "hwfilter") == 0)
+        backend = BACKEND_HW_FILTER;
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "null") == 0)
+            nullSink = true;
+        else if (strcmp(argv[i], "--dispatch") == 0)
+            dispatch = true;
+        else if (strcmp(argv[i], "ppm") != 0)
+            device = argv[i];
+    }
+
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    if (backend != BACKEND_SW) {
+        for (int i = 0;; i++) {
+            const AVCodecHWConfig *config = avcodec_get_hw_config(decoder, i);
+            if (!config) {
+                fprintf(stderr, "Decoder %s does not support vaapi.\n", decoder->name);
+                return -1;
+            }
+            if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX &&
+                config->device_type == AV_HWDEVICE_TYPE_VAAPI) {
+                hw_pix_fmt = config->pix_fmt;
+                break;
+            }
+        }
+        if (av_hwdevice_ctx_create(&hw_device_ctx, AV_HWDEVICE_TYPE_VAAPI, device, NULL, 0) < 0) {
+            fprintf(stderr, "Failed to create specified HW device.\n");
+            return -1;
+        }
+        decoder_ctx->hw_device_ctx = av_buffer_ref(hw_device_ctx);
+        decoder_ctx->get_format = get_hw_format;
+    }
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    printf("Decoder name: %s, %s path\n", decoder->name, dispatch ? "runtime dispatched" : "specialized");
+
+    // the surfaces' download format picks the hwtransfer specialization, probed before timing
+    AVPixelFormat downloadFormat = AV_PIX_FMT_NONE;
+    if (backend == BACKEND_HW_TRANSFER && !dispatch)
+        downloadFormat = probe_download_format(input_ctx, decoder_ctx, video_stream);
+
+    int64_t start = av_gettime_relative();
+    int frames = dispatch ? run_dispatched(backend, nullSink, input_ctx, decoder_ctx, video_stream)
+                          : run_specialized(backend, nullSink, downloadFormat, input_ctx, decoder_ctx, video_stream);
+    double took = (av_gettime_relative() - start) / 1000000.0;
+
+    if (frames >= 0) {
+        fprintf(stdout, "Took %f\n", took);
+        fprintf(stdout, "FPS %f\n", frames / took);
+    }
+
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    av_buffer_unref(&hw_device_ctx);
+
+    return frames >= 0 ? 0 : -1;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file
+ * Single thumbnail job backed by the persistent thumbnail cache.
+ *
+ * The cache is consulted before any decode work starts: on a hit the input is only fingerprinted
+ * (two small reads), no demuxer or decoder is opened.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "thumbnailcache.h"
+#include "decodeuntil.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+char buf[200];
+
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+static AVFrame* decode_thumbnail(const char* filename, int64_t timestamp_ms)
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVFrame* frame = NULL;
+    AVFrame* pFrameRGB = NULL;
+    struct SwsContext* sws_ctx = NULL;
+
+    if (avformat_open_input(&input_ctx, filename, NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", filename);
+        return NULL;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        goto end;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        goto end;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        goto end;
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        goto end;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        goto end;
+    }
+
+    {
+        int64_t start_time = video->start_time != AV_NOPTS_VALUE ? video->start_time : 0;
+        int64_t target = start_time + av_rescale_q(timestamp_ms, (AVRational){1, 1000}, video->time_base);
+        av_seek_frame(input_ctx, video_stream, target, AVSEEK_FLAG_BACKWARD);
+
+        frame = av_frame_alloc();
+        if (decode_until(input_ctx, decoder_ctx, video_stream, target, frame) < 0) {
+            fprintf(stderr, "No frame decoded at %lld ms\n", (long long)timestamp_ms);
+            goto end;
+        }
+    }
+
+    sws_ctx = sws_getContext(frame->width,
+                            frame->height,
+                            (AVPixelFormat)frame->format,
+                            400,
+                            300,
+                            FORMAT,
+                            SWS_BILINEAR,
+                            NULL,
+                            NULL,
+                            NULL
+                        );
+    if (!sws_ctx) {
+        fprintf(stderr, "Cannot convert %s frames\n", av_get_pix_fmt_name((AVPixelFormat)frame->format));
+        goto end;
+    }
+    pFrameRGB = allocateFrame(400, 300, FORMAT);
+    sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+            frame->linesize, 0, frame->height,
+            pFrameRGB->data, pFrameRGB->linesize);
+
+end:
+    sws_freeContext(sws_ctx);
+    av_frame_free(&frame);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+    return pFrameRGB;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input file> <time in seconds> [cache directory] [max cache size in MB]\n", argv[0]);
+        return -1;
+    }
+    const char* input = argv[1];
+    int64_t timestamp_ms = (int64_t)(atof(argv[2]) * 1000);
+    const char* cacheDir = argc >= 4 ? argv[3] : "/tmp/thumbnailcache";
+    int64_t maxBytes = (argc >= 5 ? atoll(argv[4]) : 256) * 1024 * 1024;
+
+    int64_t start = av_gettime_relative();
+
+    ThumbnailKey key;
+    memset(&key, 0, sizeof(key));
+    if (fingerprintFile(input, &key.fingerprint) < 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", input);
+        return -1;
+    }
+    key.timestamp_ms = timestamp_ms;
+    key.width = 400;
+    key.height = 300;
+    key.format = FORMAT;
+
+    AVFrame* pFrameRGB = thumbnailCacheLoad(cacheDir, &key);
+    bool hit = pFrameRGB != NULL;
+
+    if (!hit) {
+        pFrameRGB = decode_thumbnail(input, timestamp_ms);
+        if (!pFrameRGB)
+            return -1;
+        thumbnailCacheStore(cacheDir, &key, pFrameRGB, maxBytes);
+    }
+
+    snprintf(buf, sizeof(buf), "/tmp/%s_%016llx_%lld.ppm", "thumbnail", (unsigned long long)key.fingerprint, (long long)timestamp_ms);
+    ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], pFrameRGB->width, pFrameRGB->height, buf);
+
+    fprintf(stdout, "Cache %s, took %.2f ms\n", hit ? "hit" : "miss", (av_gettime_relative() - start) / 1000.0);
+    fprintf(stdout, "Saved %s\n", buf);
+
+    av_freep(&pFrameRGB->opaque);
+    av_frame_free(&pFrameRGB);
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include "xxhash.h"
+
+extern "C" {
+#include "helper.h"
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+/**
+ * Disk backed thumbnail cache.
+ *
+ * Entries are keyed by a content fingerprint of the input (file size and sampled head/tail blocks),
+ * the requested timestamp and the output geometry/format, so a lookup needs no decoder at all.
+ * Writes go to a temporary file that is renamed into place, so several processes can share the
+ * directory. The cache is bounded in size, the least recently used entries (by mtime) are evicted.
+ */
+
+#define THUMBNAIL_CACHE_MAGIC "THMBCAC1"
+#define FINGERPRINT_BLOCK_SIZE (256 * 1024)
+
+struct ThumbnailKey
+{
+    uint64_t fingerprint;
+    int64_t timestamp_ms;
+    int width;
+    int height;
+    AVPixelFormat format;
+};
+
+struct ThumbnailHeader
+{
+    char magic[8];
+    uint64_t fingerprint;
+    int64_t timestamp_ms;
+    int32_t width;
+    int32_t height;
+    int32_t format;
+    int32_t dataSize;
+};
+
+static int fingerprintFile(const char* path, uint64_t* fingerprint)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    int64_t size = st.st_size;
+    std::vector<uint8_t> block(FINGERPRINT_BLOCK_SIZE);
+
+    uint64_t hash = xxh64(&size, sizeof(size), 0);
+
+    ssize_t head = pread(fd, block.data(), block.size(), 0);
+    if (head > 0)
+        hash = xxh64(block.data(), head, hash);
+
+    if (size > FINGERPRINT_BLOCK_SIZE) {
+        off_t tailOffset = std::max<int64_t>(FINGERPRINT_BLOCK_SIZE, size - FINGERPRINT_BLOCK_SIZE);
+        ssize_t tail = pread(fd, block.data(), block.size(), tailOffset);
+        if (tail > 0)
+            hash = xxh64(block.data(), tail, hash);
+    }
+
+    close(fd);
+    *fingerprint = hash;
+    return 0;
+}
+
+static void thumbnailCachePath(const char* dir, const ThumbnailKey* key, char* path, size_t size)
+{
+    snprintf(path, size, "%s/%016llx_%lld_%dx%d_%s.thumb", dir,
+             (unsigned long long)key->fingerprint, (long long)key->timestamp_ms,
+             key->width, key->height, av_get_pix_fmt_name(key->format));
+}
+
+/* Returns the cached thumbnail (allocated with allocateFrame) or NULL on miss */
+static AVFrame* thumbnailCacheLoad(const char* dir, const ThumbnailKey* key)
+{
+    char path[1024];
+    ThumbnailHeader header;
+
+    thumbnailCachePath(dir, key, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    int dataSize = av_image_get_buffer_size(key->format, key->width, key->height, 1);
+
+    if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, THUMBNAIL_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.fingerprint != key->fingerprint || header.timestamp_ms != key->timestamp_ms ||
+        header.width != key->width || header.height != key->height ||
+        header.format != key->format || header.dataSize != dataSize) {
+        close(fd);
+        return NULL;
+    }
+
+    AVFrame* frame = allocateFrame(key->width, key->height, key->format);
+    ssize_t readBytes = read(fd, frame->opaque, dataSize);
+    close(fd);
+
+    if (readBytes != dataSize) {
+        av_freep(&frame->opaque);
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    // mtime is the LRU clock
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return frame;
+}
+
+static void thumbnailCacheEvict(const char* dir, int64_t maxBytes)
+{
+    struct Entry
+    {
+        std::string path;
+        int64_t size;
+        struct timespec mtime;
+    };
+    char lockPath[1024];
+    std::vector<Entry> entries;
+    int64_t total = 0;
+
+    // only one process evicts at a time, the others skip instead of waiting
+    snprintf(lockPath, sizeof(lockPath), "%s/.lock", dir);
+    int lockFd = open(lockPath, O_RDWR | O_CREAT, 0666);
+    if (lockFd < 0)
+        return;
+    if (flock(lockFd, LOCK_EX | LOCK_NB) < 0) {
+        close(lockFd);
+        return;
+    }
+
+    DIR* d = opendir(dir);
+    if (d) {
+        struct dirent* entry;
+        time_t now = time(NULL);
+        while ((entry = readdir(d)) != NULL) {
+            std::string name = entry->d_name;
+            std::string path = std::string(dir) + "/" + name;
+            struct stat st;
+
+            if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+                continue;
+
+            if (name.compare(0, 5, ".tmp.") == 0) {
+                // left behind by a crashed writer
+                if (now - st.st_mtime > 3600)
+                    unlink(path.c_str());
+                continue;
+            }
+            if (name.size() < 6 || name.compare(name.size() - 6, 6, ".thumb") != 0)
+                continue;
+
+            entries.push_back({path, (int64_t)st.st_size, st.st_mtim});
+            total += st.st_size;
+        }
+        closedir(d);
+    }
+
+    if (total > maxBytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            if (a.mtime.tv_sec != b.mtime.tv_sec)
+                return a.mtime.tv_sec < b.mtime.tv_sec;
+            return a.mtime.tv_nsec < b.mtime.tv_nsec;
+        });
+        // evict a bit more than needed, so not every store has to rescan the directory
+        int64_t target = maxBytes * 9 / 10;
+        for (size_t i = 0; i < entries.size() && total > target; ++i) {
+            if (unlink(entries[i].path.c_str()) == 0 || errno == ENOENT)
+                total -= entries[i].size;
+        }
+    }
+
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+}
+
+static int thumbnailCacheStore(const char* dir, const ThumbnailKey* key, const AVFrame* frame, int64_t maxBytes)
+{
+    char path[1024];
+    char tmpPath[1024];
+    ThumbnailHeader header;
+
+    int dataSize = av_image_get_buffer_size(key->format, key->width, key->height, 1);
+    std::vector<uint8_t> data(dataSize);
+    av_image_copy_to_buffer(data.data(), dataSize, (const uint8_t * const *)frame->data, frame->linesize,
+                            key->format, key->width, key->height, 1);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, THUMBNAIL_CACHE_MAGIC, sizeof(header.magic));
+    header.fingerprint = key->fingerprint;
+    header.timestamp_ms = key->timestamp_ms;
+    header.width = key->width;
+    header.height = key->height;
+    header.format = key->format;
+    header.dataSize = dataSize;
+
+    mkdir(dir, 0777);
+    thumbnailCachePath(dir, key, path, sizeof(path));
+    snprintf(tmpPath, sizeof(tmpPath), "%s/.tmp.XXXXXX", dir);
+
+    int fd = mkstemp(tmpPath);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create cache file in '%s'\n", dir);
+        return -1;
+    }
+    fchmod(fd, 0644);
+
+    if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+        write(fd, data.data(), dataSize) != dataSize) {
+        fprintf(stderr, "Cannot write cache file '%s'\n", tmpPath);
+        close(fd);
+        unlink(tmpPath);
+        return -1;
+    }
+    close(fd);
+
+    // readers either see the old entry, no entry or the complete new one
+    if (rename(tmpPath, path) < 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+
+    thumbnailCacheEvict(dir, maxBytes);
+    return 0;
+}
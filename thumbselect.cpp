@@ -0,0 +1,224 @@
+/**
+ * @file
+ * Content aware thumbnail selection in a single decode pass.
+ *
+ * Instead of saving every 100th frame (often a black or blurred transition frame) every decoded frame is
+ * scored on a 64x36 luma proxy and only the best frame of each scene (or interval) is converted and saved.
+ * The fixed mode keeps the old sampling for comparison and prints the scores of the frames it picked.
+ * Decode, analysis and conversion time are measured separately, analysis is reported relative to decode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "scenescore.h"
+
+extern "C" {
+#include "helper.h"
+#include "debugimage.h"
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_RGB24;
+
+int imageNumber = 0;
+char buf[200];
+
+struct SwsContext* sws_ctx = NULL;
+AVFrame* pFrameRGB;
+SceneSelector* selector = NULL; // NULL in fixed mode
+AVRational timeBase;
+int savedThumbnails = 0;
+
+int64_t decodeTime = 0;
+int64_t analysisTime = 0;
+int64_t convertTime = 0;
+
+static double frame_time(const AVFrame* frame)
+{
+    int64_t pts = frame->best_effort_timestamp;
+    return pts != AV_NOPTS_VALUE ? pts * av_q2d(timeBase) : 0;
+}
+
+static void save_thumbnail(const AVFrame* frame, double time, const FrameFeatures& features, double sceneStart)
+{
+    int64_t start = av_gettime_relative();
+    sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, (AVPixelFormat)frame->format,
+                                   width, height, FORMAT, SWS_BILINEAR, NULL, NULL, NULL);
+    sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+            frame->linesize, 0, frame->height,
+            pFrameRGB->data, pFrameRGB->linesize);
+
+    savedThumbnails += 1;
+    snprintf(buf, sizeof(buf), "/tmp/%s_%03d.ppm", "thumbselect", savedThumbnails);
+    ppm_save(pFrameRGB->data[0], pFrameRGB->linesize[0], width, height, buf);
+    convertTime += av_gettime_relative() - start;
+
+    if (sceneStart >= 0)
+        fprintf(stdout, "%s: %.2f s (scene from %.2f s), sharpness %.1f, luma %.0f, diff %.1f\n", buf, time,
+                sceneStart, features.sharpness, features.meanLuma, features.sad);
+    else
+        fprintf(stdout, "%s: %.2f s, sharpness %.1f, luma %.0f, diff %.1f\n", buf, time,
+                features.sharpness, features.meanLuma, features.sad);
+}
+
+static void save_selections()
+{
+    while (selector->hasSelection()) {
+        SceneSelection selection = selector->take();
+        save_thumbnail(selection.frame, selection.time, selection.features, selection.sceneStart);
+        av_frame_free(&selection.frame);
+    }
+}
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    int64_t start = av_gettime_relative();
+    ret = avcodec_send_packet(avctx, packet);
+    decodeTime += av_gettime_relative() - start;
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        start = av_gettime_relative();
+        ret = avcodec_receive_frame(avctx, frame);
+        decodeTime += av_gettime_relative() - start;
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        imageNumber += 1;
+
+        if (selector) {
+            start = av_gettime_relative();
+            bool ended = selector->add(frame, frame_time(frame));
+            analysisTime += av_gettime_relative() - start;
+            if (ended)
+                save_selections();
+        } else if (imageNumber % 100 == 0) {
+            // score the picked frame too, to see how many bad ones the fixed sampling picks
+            SceneSelector scorer(SELECT_INTERVALS, 0);
+            scorer.add(frame, 0);
+            save_thumbnail(frame, frame_time(frame), scorer.lastFeatures(), -1);
+        }
+
+        av_frame_free(&frame);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [scene|interval|fixed] [interval / max scene length in s]\n", argv[0]);
+        return -1;
+    }
+    const char* mode = argc >= 3 ? argv[2] : "scene";
+    double interval = argc >= 4 ? atof(argv[3]) : 10;
+
+    if (strcmp(mode, "scene") == 0)
+        selector = new SceneSelector(SELECT_SCENES, interval);
+    else if (strcmp(mode, "interval") == 0)
+        selector = new SceneSelector(SELECT_INTERVALS, interval);
+    else if (strcmp(mode, "fixed") != 0) {
+        fprintf(stderr, "Unknown mode '%s'\n", mode);
+        return -1;
+    }
+
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+    timeBase = video->time_base;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    pFrameRGB = allocateFrame(width, height, FORMAT);
+    printf("Decoder name: %s, %s mode\n", decoder->name, mode);
+
+    int64_t start = av_gettime_relative();
+
+    while (ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index)
+            ret = decode_write(decoder_ctx, &packet);
+
+        av_packet_unref(&packet);
+    }
+
+    /* flush the decoder */
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_write(decoder_ctx, &packet);
+    av_packet_unref(&packet);
+
+    if (selector && selector->finish())
+        save_selections();
+
+    double took = (av_gettime_relative() - start) / 1000000.0;
+    fprintf(stdout, "Took %f s, %d frames, %d thumbnails\n", took, imageNumber, savedThumbnails);
+    fprintf(stdout, "Decode %.1f ms, analysis %.1f ms (%.2f%% of decode, %.1f us per frame), conversion %.1f ms\n",
+            decodeTime / 1000.0, analysisTime / 1000.0, decodeTime ? 100.0 * analysisTime / decodeTime : 0,
+            imageNumber ? (double)analysisTime / imageNumber : 0, convertTime / 1000.0);
+
+    delete selector;
+    av_freep(&pFrameRGB->opaque);
+    av_frame_free(&pFrameRGB);
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "packetqueue.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/time.h>
+}
+
+/**
+ * Audio waveform peaks extracted in the same demux pass as the video decoding.
+ *
+ * The demuxing loop hands the audio packets over (a reference, no copy) and a dedicated thread decodes
+ * them, resamples to mono float at the source rate and reduces the samples into a min/max peak pyramid:
+ * level 0 has one peak per WAVEFORM_BASE_SAMPLES samples, every further level combines
+ * WAVEFORM_LEVEL_FACTOR peaks of the previous one. The pyramid is built incrementally, so memory is
+ * bounded by the peaks and the file is written at the end without a second pass over the input.
+ *
+ * File layout (native endianness):
+ *   WaveformFileHeader
+ *   WaveformLevelHeader x levelCount
+ *   per level peakCount x (int16 min, int16 max), level 0 first
+ */
+
+#define WAVEFORM_MAGIC "WAVEPKS1"
+#define WAVEFORM_BASE_SAMPLES 64
+#define WAVEFORM_LEVEL_FACTOR 4
+#define WAVEFORM_LEVELS 6
+
+struct WaveformFileHeader
+{
+    char magic[8];
+    int32_t sampleRate;
+    int32_t levelCount;
+    int64_t sampleCount;
+    int64_t startTimeUs; // of the first sample, in the timeline of the input
+};
+
+struct WaveformLevelHeader
+{
+    int32_t samplesPerPeak;
+    int32_t reserved;
+    int64_t peakCount;
+};
+
+class WaveformExtractor
+{
+public:
+    WaveformExtractor()
+        : queue(256), decoder_ctx(NULL), swr_ctx(NULL), stream(NULL), streamIndex(-1),
+          sampleRate(0), sampleCount(0), startTimeUs(AV_NOPTS_VALUE), workTime(0)
+    {
+        for (int i = 0; i < WAVEFORM_LEVELS; ++i) {
+            levels[i].samplesPerPeak = i == 0 ? WAVEFORM_BASE_SAMPLES : levels[i - 1].samplesPerPeak * WAVEFORM_LEVEL_FACTOR;
+            levels[i].min = 0;
+            levels[i].max = 0;
+            levels[i].count = 0;
+        }
+    }
+
+    ~WaveformExtractor()
+    {
+        queue.close();
+        if (worker.joinable())
+            worker.join();
+        swr_free(&swr_ctx);
+        avcodec_free_context(&decoder_ctx);
+    }
+
+    /* Opens the decoder of the audio stream belonging to the video stream and starts the audio thread */
+    int open(AVFormatContext* input_ctx, int videoStream)
+    {
+        const AVCodec* decoder = NULL;
+        int ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_AUDIO, -1, videoStream, &decoder, 0);
+        if (ret < 0) {
+            fprintf(stderr, "Cannot find an audio stream for the waveform\n");
+            return -1;
+        }
+        streamIndex = ret;
+        stream = input_ctx->streams[streamIndex];
+
+        if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+            return AVERROR(ENOMEM);
+        if (avcodec_parameters_to_context(decoder_ctx, stream->codecpar) < 0)
+            return -1;
+        decoder_ctx->pkt_timebase = stream->time_base;
+        // audio decoding is cheap, leave the cores to the video decoder
+        decoder_ctx->thread_count = 1;
+
+        if (avcodec_open2(decoder_ctx, decoder, NULL) < 0) {
+            fprintf(stderr, "Failed to open audio codec for stream #%u\n", streamIndex);
+            return -1;
+        }
+
+        worker = std::thread(&WaveformExtractor::decoderLoop, this);
+        return 0;
+    }
+
+    int getStreamIndex() const
+    {
+        return streamIndex;
+    }
+
+    /* Called from the demuxing loop, only takes a new reference of the packet */
+    void push(const AVPacket* packet)
+    {
+        AVPacket* ref = av_packet_clone(packet);
+        if (ref)
+            queue.push(ref);
+    }
+
+    /* Drains the audio thread and writes the pyramid */
+    int finish(const char* filename)
+    {
+        queue.close();
+        if (worker.joinable())
+            worker.join();
+
+        FILE* file = fopen(filename, "wb");
+        if (!file) {
+            fprintf(stderr, "Cannot open waveform file '%s'\n", filename);
+            return -1;
+        }
+
+        WaveformFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, WAVEFORM_MAGIC, sizeof(header.magic));
+        header.sampleRate = sampleRate;
+        header.levelCount = WAVEFORM_LEVELS;
+        header.sampleCount = sampleCount;
+        header.startTimeUs = startTimeUs == AV_NOPTS_VALUE ? 0 : startTimeUs;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (int i = 0; i < WAVEFORM_LEVELS && ok; ++i) {
+            WaveformLevelHeader levelHeader = { levels[i].samplesPerPeak, 0, (int64_t)levels[i].peaks.size() / 2 };
+            ok = fwrite(&levelHeader, sizeof(levelHeader), 1, file) == 1;
+        }
+        for (int i = 0; i < WAVEFORM_LEVELS && ok; ++i) {
+            const std::vector<int16_t>& peaks = levels[i].peaks;
+            ok = peaks.empty() || fwrite(peaks.data(), sizeof(int16_t), peaks.size(), file) == peaks.size();
+        }
+
+        if (fclose(file) != 0 || !ok) {
+            fprintf(stderr, "Error writing waveform file '%s'\n", filename);
+            return -1;
+        }
+
+        fprintf(stdout, "Waveform: %lld samples at %d Hz, %d levels, %.1f ms of work on the audio thread\n",
+                (long long)sampleCount, sampleRate, WAVEFORM_LEVELS, workTime / 1000.0);
+        return 0;
+    }
+
+private:
+    struct PeakLevel
+    {
+        int samplesPerPeak;
+        std::vector<int16_t> peaks; // min, max pairs
+        float min;
+        float max;
+        int count; // samples (level 0) or peaks of the level below accumulated so far
+    };
+
+    void decoderLoop()
+    {
+        AVPacket* packet;
+        AVFrame* frame = av_frame_alloc();
+
+        while ((packet = queue.pop()) != NULL) {
+            int64_t start = av_gettime_relative();
+            decodePacket(packet, frame);
+            av_packet_free(&packet);
+            workTime += av_gettime_relative() - start;
+        }
+
+        int64_t start = av_gettime_relative();
+        decodePacket(NULL, frame);
+        if (swr_ctx)
+            convert(NULL, 0);
+        for (int i = 0; i < WAVEFORM_LEVELS; ++i) {
+            if (levels[i].count > 0)
+                emitPeak(i, levels[i].min, levels[i].max);
+        }
+        workTime += av_gettime_relative() - start;
+
+        av_frame_free(&frame);
+    }
+
+    void decodePacket(AVPacket* packet, AVFrame* frame)
+    {
+        if (avcodec_send_packet(decoder_ctx, packet) < 0) {
+            // a broken audio packet must not stop the waveform
+            return;
+        }
+
+        while (avcodec_receive_frame(decoder_ctx, frame) >= 0) {
+            if (!swr_ctx && initResampler(frame) < 0) {
+                av_frame_unref(frame);
+                continue;
+            }
+            if (startTimeUs == AV_NOPTS_VALUE && frame->best_effort_timestamp != AV_NOPTS_VALUE)
+                startTimeUs = av_rescale_q(frame->best_effort_timestamp, stream->time_base, AV_TIME_BASE_Q);
+
+            convert((const uint8_t**)frame->extended_data, frame->nb_samples);
+            av_frame_unref(frame);
+        }
+    }
+
+    /* The layout is only reliable from the first decoded frame on */
+    int initResampler(const AVFrame* frame)
+    {
+        AVChannelLayout monoLayout = AV_CHANNEL_LAYOUT_MONO;
+
+        sampleRate = frame->sample_rate;
+        if (swr_alloc_set_opts2(&swr_ctx, &monoLayout, AV_SAMPLE_FMT_FLT, sampleRate,
+                                &frame->ch_layout, (AVSampleFormat)frame->format, sampleRate, 0, NULL) < 0 ||
+            swr_init(swr_ctx) < 0) {
+            fprintf(stderr, "Cannot create the audio resampler\n");
+            swr_free(&swr_ctx);
+            return -1;
+        }
+        return 0;
+    }
+
+    void convert(const uint8_t** input, int inputSamples)
+    {
+        int outSamples = swr_get_out_samples(swr_ctx, inputSamples);
+        if (outSamples <= 0)
+            return;
+        if ((int)mono.size() < outSamples)
+            mono.resize(outSamples);
+
+        uint8_t* output = (uint8_t*)mono.data();
+        int converted = swr_convert(swr_ctx, &output, outSamples, input, inputSamples);
+        if (converted > 0)
+            addSamples(mono.data(), converted);
+    }
+
+    void addSamples(const float* samples, int count)
+    {
+        PeakLevel& level = levels[0];
+
+        sampleCount += count;
+        while (count > 0) {
+            int n = std::min(count, level.samplesPerPeak - level.count);
+            float min = level.count ? level.min : samples[0];
+            float max = level.count ? level.max : samples[0];
+
+            for (int i = 0; i < n; ++i) {
+                min = std::min(min, samples[i]);
+                max = std::max(max, samples[i]);
+            }
+            level.min = min;
+            level.max = max;
+            level.count += n;
+            samples += n;
+            count -= n;
+
+            if (level.count == level.samplesPerPeak)
+                emitPeak(0, level.min, level.max);
+        }
+    }
+
+    /* Stores a finished peak of a level and folds it into the level above */
+    void emitPeak(int index, float min, float max)
+    {
+        PeakLevel& level = levels[index];
+
+        level.peaks.push_back(toSample(min));
+        level.peaks.push_back(toSample(max));
+        level.count = 0;
+
+        if (index + 1 == WAVEFORM_LEVELS)
+            return;
+
+        PeakLevel& parent = levels[index + 1];
+        parent.min = parent.count ? std::min(parent.min, min) : min;
+        parent.max = parent.count ? std::max(parent.max, max) : max;
+        parent.count += 1;
+        if (parent.count == WAVEFORM_LEVEL_FACTOR)
+            emitPeak(index + 1, parent.min, parent.max);
+    }
+
+    static int16_t toSample(float value)
+    {
+        return (int16_t)lrintf(std::max(-1.0f, std::min(1.0f, value)) * 32767.0f);
+    }
+
+    PacketQueue queue;
+    std::thread worker;
+    AVCodecContext* decoder_ctx;
+    SwrContext* swr_ctx;
+    AVStream* stream;
+    int streamIndex;
+    int sampleRate;
+    int64_t sampleCount;
+    int64_t startTimeUs;
+    int64_t workTime;
+    std::vector<float> mono;
+    PeakLevel levels[WAVEFORM_LEVELS];
+};
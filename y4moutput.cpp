@@ -0,0 +1,286 @@
+/**
+ * @file
+ * Streams every scaled frame to stdout as YUV4MPEG2 (yuv420p) or raw rgb24, to pipe it into another tool.
+ *
+ * sws_scale writes straight into page aligned buffers from a pool. When stdout is a pipe the buffers
+ * are handed to the kernel with vmsplice, so the pixels are not copied again. Otherwise the frame header
+ * and all planes, which are contiguous in the buffer, go out with a single large write.
+ * The fwrite mode is the plain stdio path, for comparison.
+ * All messages go to stderr, stdout only carries the stream.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+#define PAGE_SIZE 4096
+#define FRAME_HEADER "FRAME\n"
+
+enum OutputMode { OUTPUT_VMSPLICE, OUTPUT_WRITE, OUTPUT_FWRITE };
+
+int width = 400;
+int height = 300;
+AVPixelFormat FORMAT = AV_PIX_FMT_YUV420P;
+bool y4m = true;
+
+OutputMode mode;
+std::vector<uint8_t*> pool;
+size_t poolIndex = 0;
+int headerSize = 0;
+int frameSize = 0;
+
+long long bytesWritten = 0;
+int64_t outputTime = 0;
+
+static int write_all(const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n;
+        if (mode == OUTPUT_VMSPLICE) {
+            struct iovec iov = { (void*)data, size };
+            n = vmsplice(STDOUT_FILENO, &iov, 1, 0);
+        } else {
+            n = write(STDOUT_FILENO, data, size);
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/*
+ * vmsplice only references our pages from the pipe, a buffer must not be rewritten until the
+ * consumer is done with it. The pool is bigger than what the pipe can hold, so by the time a buffer
+ * comes around again the pipe has drained it. That is only enough when the reader copies the data out
+ * with read(): a reader that splices or tees the pages onward keeps referencing them after the pipe
+ * has drained, and would see later frames. Use the write mode for such readers.
+ */
+static void init_pool()
+{
+    int pipeSize = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+    size_t bufferSize = FFALIGN(headerSize + frameSize, PAGE_SIZE);
+    size_t count = mode == OUTPUT_VMSPLICE && pipeSize > 0 ? pipeSize / bufferSize + 3 : 1;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t* buffer;
+        if (posix_memalign((void**)&buffer, PAGE_SIZE, bufferSize) != 0) {
+            fprintf(stderr, "Can not allocate output buffer\n");
+            exit(1);
+        }
+        memcpy(buffer, FRAME_HEADER, headerSize);
+        pool.push_back(buffer);
+    }
+    fprintf(stderr, "Output pool %zu x %zu bytes, pipe size %d\n", count, bufferSize, pipeSize);
+}
+
+static int output_frame(AVFrame* frame, struct SwsContext* sws_ctx)
+{
+    uint8_t* buffer = pool[poolIndex];
+    uint8_t* dst[4];
+    int dstLinesize[4];
+    int ret = 0;
+
+    poolIndex = (poolIndex + 1) % pool.size();
+
+    // planes packed right after the frame header, exactly as they go out
+    av_image_fill_arrays(dst, dstLinesize, buffer + headerSize, FORMAT, width, height, 1);
+    sws_scale(sws_ctx, (uint8_t const * const *)frame->data,
+            frame->linesize, 0, frame->height,
+            dst, dstLinesize);
+
+    int64_t start = av_gettime_relative();
+    if (mode == OUTPUT_FWRITE) {
+        if (fwrite(buffer, 1, headerSize + frameSize, stdout) != (size_t)(headerSize + frameSize))
+            ret = -1;
+    } else {
+        ret = write_all(buffer, headerSize + frameSize);
+    }
+    outputTime += av_gettime_relative() - start;
+    bytesWritten += headerSize + frameSize;
+
+    if (ret < 0)
+        fprintf(stderr, "Error writing output\n");
+    return ret;
+}
+
+static int decode_write(AVCodecContext *avctx, AVPacket *packet, struct SwsContext* sws_ctx)
+{
+    AVFrame *frame = NULL;
+    int ret = 0;
+
+    ret = avcodec_send_packet(avctx, packet);
+    if (ret < 0) {
+        fprintf(stderr, "Error during decoding\n");
+        return ret;
+    }
+
+    while (1) {
+        if (!(frame = av_frame_alloc())) {
+            fprintf(stderr, "Can not alloc frame\n");
+            return AVERROR(ENOMEM);
+        }
+
+        ret = avcodec_receive_frame(avctx, frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_frame_free(&frame);
+            return 0;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error while decoding\n");
+            av_frame_free(&frame);
+            return ret;
+        }
+
+        ret = output_frame(frame, sws_ctx);
+        av_frame_free(&frame);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    AVFormatContext *input_ctx = NULL;
+    int video_stream, ret;
+    AVStream *video = NULL;
+    AVCodecContext *decoder_ctx = NULL;
+    const AVCodec *decoder = NULL;
+    AVPacket packet;
+    struct stat st;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <input file> [y4m|raw] [auto|write|fwrite]\n"
+                        "auto uses vmsplice into pipes, the reader must read() the data, not splice or tee it on\n", argv[0]);
+        return -1;
+    }
+    if (argc >= 3 && strcmp(argv[2], "raw") == 0) {
+        y4m = false;
+        FORMAT = AV_PIX_FMT_RGB24;
+    }
+    const char* modeName = argc >= 4 ? argv[3] : "auto";
+
+    bool isPipe = fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode);
+    if (strcmp(modeName, "fwrite") == 0) {
+        mode = OUTPUT_FWRITE;
+    } else if (strcmp(modeName, "write") == 0 || !isPipe) {
+        mode = OUTPUT_WRITE;
+    } else {
+        mode = OUTPUT_VMSPLICE;
+        fcntl(STDOUT_FILENO, F_SETPIPE_SZ, 1024 * 1024);
+    }
+
+    if (avformat_open_input(&input_ctx, argv[1], NULL, NULL) != 0) {
+        fprintf(stderr, "Cannot open input file '%s'\n", argv[1]);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(input_ctx, NULL) < 0) {
+        fprintf(stderr, "Cannot find input stream information.\n");
+        return -1;
+    }
+
+    ret = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot find a video stream in the input file\n");
+        return -1;
+    }
+    video_stream = ret;
+
+    if (!(decoder_ctx = avcodec_alloc_context3(decoder)))
+        return AVERROR(ENOMEM);
+
+    video = input_ctx->streams[video_stream];
+    if (avcodec_parameters_to_context(decoder_ctx, video->codecpar) < 0)
+        return -1;
+
+    decoder_ctx->thread_count = 0; // 0 = automatic
+    decoder_ctx->thread_type = (FF_THREAD_FRAME | FF_THREAD_SLICE);
+
+    if ((ret = avcodec_open2(decoder_ctx, decoder, NULL)) < 0) {
+        fprintf(stderr, "Failed to open codec for stream #%u\n", video_stream);
+        return -1;
+    }
+
+    struct SwsContext* sws_ctx = sws_getContext(decoder_ctx->width,
+                                decoder_ctx->height,
+                                decoder_ctx->pix_fmt,
+                                width,
+                                height,
+                                FORMAT,
+                                SWS_BILINEAR,
+                                NULL,
+                                NULL,
+                                NULL
+                            );
+
+    headerSize = y4m ? strlen(FRAME_HEADER) : 0;
+    frameSize = av_image_get_buffer_size(FORMAT, width, height, 1);
+    init_pool();
+
+    if (y4m) {
+        char streamHeader[128];
+        AVRational rate = video->avg_frame_rate.num > 0 ? video->avg_frame_rate : (AVRational){25, 1};
+        int size = snprintf(streamHeader, sizeof(streamHeader), "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n",
+                            width, height, rate.num, rate.den);
+        if (write(STDOUT_FILENO, streamHeader, size) != size) {
+            fprintf(stderr, "Error writing output\n");
+            return -1;
+        }
+    }
+
+    fprintf(stderr, "Decoder name: %s, output %s using %s\n", decoder->name, y4m ? "y4m" : "raw rgb24",
+            mode == OUTPUT_VMSPLICE ? "vmsplice" : mode == OUTPUT_WRITE ? "write" : "fwrite");
+
+    int64_t start = av_gettime_relative();
+    long frames = 0;
+
+    while (ret >= 0) {
+        if ((ret = av_read_frame(input_ctx, &packet)) < 0)
+            break;
+
+        if (video_stream == packet.stream_index) {
+            ret = decode_write(decoder_ctx, &packet, sws_ctx);
+            frames += 1;
+        }
+
+        av_packet_unref(&packet);
+    }
+
+    /* flush the decoder */
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_write(decoder_ctx, &packet, sws_ctx);
+    av_packet_unref(&packet);
+    fflush(stdout);
+
+    double took = (av_gettime_relative() - start) / 1000000.0;
+    fprintf(stderr, "Took %f s, FPS %f\n", took, frames / took);
+    fprintf(stderr, "Written %.1f MB, %.1f MB/s, %.2f%% of the time spent in output\n",
+            bytesWritten / (1024.0 * 1024.0), bytesWritten / (1024.0 * 1024.0) / took,
+            100.0 * outputTime / (took * 1000000.0));
+
+    for (uint8_t* buffer : pool)
+        free(buffer);
+    sws_freeContext(sws_ctx);
+    avcodec_free_context(&decoder_ctx);
+    avformat_close_input(&input_ctx);
+
+    return 0;
+}